@@ -0,0 +1,247 @@
+//---------------------------------------------------------------------------
+// Benchmark driver: runs the crawler against the mock server & reports its speed.
+// It writes config.txt & a hosts file in the work directory, starts mockServer,
+// runs the crawler there, then reads the crawler output & its resource usage.
+// --compression 1 has the crawler ask for compressed pages & the server send them.
+// --validators 1 has the server send ETags & the crawler keep a page cache in the
+// work directory; run it twice for a recrawl with conditional requests.
+//
+// ./benchDriver [--crawler ./crawler] [--server bench/mockServer] [--dir bench/run]
+//               [--threads 4] [--connections 200] [--start 10] [--depth 10] [--shards 1]
+//               [--pages-limit 20] [--linked 10] [--crawl-delay 0] [--page-timeout 10000]
+//               [--host-connections 1] [--compression 0] [--validators 0]
+//               [server options, see mockServer.cpp]
+//---------------------------------------------------------------------------
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+using namespace std;
+using namespace std::chrono;
+
+typedef struct {
+    string crawler = "./crawler";
+    string server = "bench/mockServer";
+    string dir = "bench/run";
+    int threads = 4;
+    int connections = 200;
+    int start = 10;                                     // starting hosts
+    int depth = 10;
+    int pagesLimit = 20;
+    int linked = 10;
+    int crawlDelay = 0;
+    int hostConnections = 1;                            // connectionsPerHost of the crawler
+    int pageTimeout = 10000;
+    int shards = 1;                                     // crawler processes (--shards)
+    int compression = 0;                                // of the crawler & the server
+    int validators = 0;                                 // server validators & crawler page cache
+    int port = 8080;
+    int hosts = 200;
+    vector<string> serverArgs;                          // passed through to mockServer
+} BenchOptions;
+
+static BenchOptions parseArgs(int argc, char *argv[]) {
+    BenchOptions bench;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        string name = argv[i], value = argv[i + 1];
+        if (name == "--crawler") bench.crawler = value;
+        else if (name == "--server") bench.server = value;
+        else if (name == "--dir") bench.dir = value;
+        else if (name == "--threads") bench.threads = stoi(value);
+        else if (name == "--connections") bench.connections = stoi(value);
+        else if (name == "--start") bench.start = stoi(value);
+        else if (name == "--depth") bench.depth = stoi(value);
+        else if (name == "--pages-limit") bench.pagesLimit = stoi(value);
+        else if (name == "--linked") bench.linked = stoi(value);
+        else if (name == "--crawl-delay") bench.crawlDelay = stoi(value);
+        else if (name == "--host-connections") bench.hostConnections = stoi(value);
+        else if (name == "--page-timeout") bench.pageTimeout = stoi(value);
+        else if (name == "--shards") bench.shards = stoi(value);
+        else {
+            if (name == "--port") bench.port = stoi(value);
+            if (name == "--hosts") bench.hosts = stoi(value);
+            if (name == "--compression") bench.compression = stoi(value);
+            if (name == "--validators") bench.validators = stoi(value);
+            bench.serverArgs.push_back(name);
+            bench.serverArgs.push_back(value);
+        }
+    }
+    bench.serverArgs.push_back("--port");
+    bench.serverArgs.push_back(to_string(bench.port));
+    bench.serverArgs.push_back("--hosts");
+    bench.serverArgs.push_back(to_string(bench.hosts));
+    return bench;
+}
+
+//---------------------------------------------------------------------------
+// config.txt & hosts for the crawler, every mock host pointing to 127.0.0.1.
+//---------------------------------------------------------------------------
+static void writeCrawlerFiles(const BenchOptions &bench) {
+    mkdir(bench.dir.c_str(), 0755);
+    ofstream hosts(bench.dir + "/hosts");
+    for (int i = 0; i < bench.hosts; i++) hosts << "127.0.0.1 h" << i << ".bench.com" << endl;
+
+    ofstream config(bench.dir + "/config.txt");
+    config << "crawlDelay " << bench.crawlDelay << endl;
+    config << "connectionsPerHost " << bench.hostConnections << endl;
+    config << "maxThreads " << bench.threads << endl;
+    config << "maxConnections " << bench.connections << endl;
+    config << "pageTimeout " << bench.pageTimeout << endl;
+    config << "compression " << bench.compression << endl;
+    if (bench.validators) config << "pageCacheFile pages.cache" << endl;
+    config << "hostsFile hosts" << endl;
+    config << "port " << bench.port << endl;
+    config << "depthLimit " << bench.depth << endl;
+    config << "pagesLimit " << bench.pagesLimit << endl;
+    config << "linkedSitesLimit " << bench.linked << endl;
+    int start = min(bench.start, bench.hosts);
+    config << "startUrls " << start << endl;
+    for (int i = 0; i < start; i++) config << "http://h" << i << ".bench.com" << endl;
+}
+
+//---------------------------------------------------------------------------
+// Start mockServer with its stdout on a pipe; wait until it accepts connections.
+//---------------------------------------------------------------------------
+static pid_t startServer(const BenchOptions &bench, int &outputFd) {
+    int fds[2];
+    if (pipe(fds) != 0) return -1;
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        vector<char *> args;
+        args.push_back((char *)bench.server.c_str());
+        for (auto &arg : bench.serverArgs) args.push_back((char *)arg.c_str());
+        args.push_back(NULL);
+        execv(bench.server.c_str(), args.data());
+        cerr << "Cannot run " << bench.server << ": " << strerror(errno) << endl;
+        _exit(127);
+    }
+    close(fds[1]);
+    outputFd = fds[0];
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(bench.port);
+    for (int attempt = 0; attempt < 100; attempt++) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        bool ready = connect(fd, (struct sockaddr *)&address, sizeof(address)) == 0;
+        close(fd);
+        if (ready) return pid;
+        if (waitpid(pid, NULL, WNOHANG) == pid) return -1;
+        usleep(20000);
+    }
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    return -1;
+}
+
+static string readAll(int fd) {
+    string data;
+    char buffer[4096];
+    ssize_t n;
+    while ((n = read(fd, buffer, sizeof(buffer))) > 0) data.append(buffer, n);
+    return data;
+}
+
+static double percentile(const vector<double> &sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t index = min(sorted.size() - 1, size_t(p / 100 * sorted.size()));
+    return sorted[index];
+}
+
+int main(int argc, char *argv[]) {
+    BenchOptions bench = parseArgs(argc, argv);
+    writeCrawlerFiles(bench);
+    string crawlerPath = bench.crawler[0] == '/' ? bench.crawler : string(getcwd(NULL, 0)) + "/" + bench.crawler;
+
+    int serverOutput;
+    pid_t server = startServer(bench, serverOutput);
+    if (server < 0) {
+        cerr << "Mock server did not start" << endl;
+        return 1;
+    }
+
+    // Run the crawler in the work directory, its statistics go to output.txt
+    steady_clock::time_point start = steady_clock::now();
+    pid_t crawler = fork();
+    if (crawler == 0) {
+        if (chdir(bench.dir.c_str()) != 0) _exit(127);
+        int out = open("output.txt", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        int err = open("stderr.txt", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        dup2(out, STDOUT_FILENO);
+        dup2(err, STDERR_FILENO);
+        string shards = to_string(bench.shards);
+        if (bench.shards > 1) execl(crawlerPath.c_str(), crawlerPath.c_str(), "--shards", shards.c_str(), (char *)NULL);
+            else execl(crawlerPath.c_str(), crawlerPath.c_str(), (char *)NULL);
+        _exit(127);
+    }
+    int status;
+    struct rusage usage;
+    wait4(crawler, &status, 0, &usage);
+    double seconds = duration<double>(steady_clock::now() - start).count();
+
+    kill(server, SIGTERM);
+    string serverStats = readAll(serverOutput);
+    waitpid(server, NULL, 0);
+    close(serverOutput);
+
+    // Pages & their response times from the crawler output
+    ifstream output(bench.dir + "/output.txt");
+    string line;
+    vector<double> latencies;
+    uint64_t sites = 0, failed = 0;
+    while (getline(output, line)) {
+        if (line.compare(0, 9, "Website: ") == 0) sites++;
+        else if (line.compare(0, 35, "Number of Pages Failed to Discover:") == 0) failed += stoull(line.substr(35));
+        else if (line.compare(0, 4, "    ") == 0) {
+            istringstream fields(line);
+            string time;
+            fields >> time;
+            if (time.size() > 2 && time.compare(time.size() - 2, 2, "ms") == 0 && isdigit(time[0])) latencies.push_back(stod(time));
+        }
+    }
+    sort(latencies.begin(), latencies.end());
+
+    uint64_t requests = 0, bytes = 0, notModified = 0;
+    istringstream serverFields(serverStats);
+    string name;
+    uint64_t value;
+    while (serverFields >> name >> value) {
+        if (name == "requests") requests = value;
+        else if (name == "bytes") bytes = value;
+        else if (name == "notModified") notModified = value;
+    }
+
+    double cpu = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+    cout << fixed << setprecision(2);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) cout << "Crawler exited abnormally (status " << status << ")" << endl;
+    cout << "Sites: " << sites << ", pages: " << latencies.size() << ", failed pages: " << failed << ", requests served: " << requests
+         << " (" << notModified << " not modified)" << endl;
+    cout << "Wall time: " << seconds << "s, CPU time: " << cpu << "s ("
+         << usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 << "s user)" << endl;
+    cout << "Pages/sec: " << latencies.size() / seconds << ", MB/sec: " << bytes / seconds / 1e6 << endl;
+    cout << "Peak RSS: " << usage.ru_maxrss / 1024.0 << " MB" << endl;
+    cout << "Latency (ms): p50 " << percentile(latencies, 50) << ", p90 " << percentile(latencies, 90)
+         << ", p99 " << percentile(latencies, 99) << ", max " << (latencies.empty() ? 0 : latencies.back()) << endl;
+    return 0;
+}
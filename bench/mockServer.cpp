@@ -0,0 +1,449 @@
+//---------------------------------------------------------------------------
+// Mock web server for benchmarks: serves a generated graph of sites on one port.
+// Hosts are h<i>.bench.com, pages /p<j>.html ("/" is page 0). Pages are built on
+// the fly from a seed, so the same options always give the same graph.
+//
+// ./mockServer [--port 8080] [--hosts 200] [--pages 20] [--degree 8] [--external-rate 0.2]
+//              [--page-size 16384] [--latency 5] [--latency-dist const|uniform|exp]
+//              [--slow-rate 0.05] [--slow-latency 500] [--fail-rate 0.02] [--seed 1]
+//              [--chunked-rate 0] [--redirect-rate 0] [--compression 0]
+//              [--validators 0] [--change-rate 0] [--generation 0] [--close-rate 0]
+//
+// --chunked-rate: part of the pages sent with Transfer-Encoding: chunked.
+// --redirect-rate: part of the pages (not "/") that moved; /p<j>.html answers
+// 301 to /m<j>.html, which serves the page.
+// --compression 1: pages are gzip (or deflate) encoded if the request accepts it.
+// --validators 1: pages have an ETag & a Last-Modified date, and a conditional
+// request matching them gets 304 Not Modified. The pages of --change-rate have
+// a new version (content, ETag & date) for each --generation.
+// --close-rate: part of the pages sent without a length, ended by closing the
+// connection (HTTP/1.0 style).
+//
+// On SIGINT/SIGTERM it prints "requests <n> bytes <n> connections <n> failed <n> notModified <n>"
+// and exits.
+//---------------------------------------------------------------------------
+
+#include <iostream>
+#include <string>
+#include <map>
+#include <deque>
+#include <queue>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <ctime>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <zlib.h>
+
+using namespace std;
+using namespace std::chrono;
+
+typedef struct {
+    int port = 8080;
+    int hosts = 200;
+    int pages = 20;                                     // pages per host
+    int degree = 8;                                     // links per page
+    double externalRate = 0.2;                          // part of the links to other hosts
+    int pageSize = 16384;                               // bytes of a page body, at least
+    double latency = 5;                                 // ms, mean response delay
+    string latencyDist = "exp";                         // const, uniform (0 to 2x mean) or exp
+    double slowRate = 0.05;                             // part of the hosts answering slowly
+    double slowLatency = 500;                           // ms, added for the slow hosts
+    double failRate = 0.02;                             // part of the hosts dropping every connection
+    double chunkedRate = 0;                             // part of the pages sent chunked
+    double redirectRate = 0;                            // part of the pages moved to /m<j>.html
+    bool compression = false;                           // gzip/deflate per Accept-Encoding
+    bool validators = false;                            // ETag, Last-Modified & 304
+    double changeRate = 0;                              // part of the pages changing with the generation
+    int generation = 0;
+    double closeRate = 0;                               // part of the pages ended by the close
+    uint64_t seed = 1;
+} ServerOptions;
+
+typedef struct {
+    string path;
+    bool keepAlive;
+    string acceptEncoding;                              // lowercase
+    string ifNoneMatch, ifModifiedSince;                // lowercase
+} Request;
+
+// A response waiting for its latency before it is sent
+typedef struct {
+    steady_clock::time_point readyAt;
+    string data;
+} DelayedResponse;
+
+typedef struct {
+    string in;                                          // received, not parsed yet
+    string out;                                         // ready to send
+    deque<DelayedResponse> delayed;                     // in request order
+    bool closeAfterSend = false;
+} Connection;
+
+static volatile sig_atomic_t stopRequested = 0;
+static ServerOptions options;
+static mt19937_64 latencyRng;
+static uint64_t numRequests = 0, numBytes = 0, numConnections = 0, numFailed = 0, numNotModified = 0;
+
+static void onSignal(int) {
+    stopRequested = 1;
+}
+
+//---------------------------------------------------------------------------
+// Stable pseudo random value in [0, 1) for a host (& page, link), independent of the request order.
+//---------------------------------------------------------------------------
+static double hashUnit(uint64_t a, uint64_t b = 0, uint64_t c = 0) {
+    uint64_t x = options.seed * 0x9E3779B97F4A7C15ULL ^ (a + 1) * 0xBF58476D1CE4E5B9ULL ^ (b + 1) * 0x94D049BB133111EBULL ^ (c + 1) * 0xD6E8FEB86659FD93ULL;
+    x ^= x >> 31; x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27; x *= 0x94D049BB133111EBULL;
+    x ^= x >> 33;
+    return double(x >> 11) / double(1ULL << 53);
+}
+
+static bool isSlowHost(int host) { return hashUnit(host, 1000001) < options.slowRate; }
+static bool isFailingHost(int host) { return hashUnit(host, 1000002) < options.failRate; }
+static bool isChunkedPage(int host, int page) { return hashUnit(host, page, 1000003) < options.chunkedRate; }
+static bool isMovedPage(int host, int page) { return page > 0 && hashUnit(host, page, 1000004) < options.redirectRate; }
+static bool isCloseDelimitedPage(int host, int page) { return hashUnit(host, page, 1000006) < options.closeRate; }
+static int pageVersion(int host, int page) { return hashUnit(host, page, 1000005) < options.changeRate ? options.generation : 0; }
+
+//---------------------------------------------------------------------------
+// Page j of host i: degree links, then filler up to pageSize.
+//---------------------------------------------------------------------------
+static string renderPage(int host, int page) {
+    string body = "<html><head><title>h" + to_string(host) + " p" + to_string(page) + " v" + to_string(pageVersion(host, page)) + "</title></head><body>\n";
+    for (int k = 0; k < options.degree; k++) {
+        if (hashUnit(host, page, 2 * k) < options.externalRate) {
+            int target = int(hashUnit(host, page, 2 * k + 1) * options.hosts);
+            body += "<a href=\"http://h" + to_string(target) + ".bench.com/\">site " + to_string(target) + "</a>\n";
+        } else {
+            int target = int(hashUnit(host, page, 2 * k + 1) * options.pages);
+            body += "<a href=\"/p" + to_string(target) + ".html\">page " + to_string(target) + "</a>\n";
+        }
+    }
+    static const string filler = "<p>Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod tempor incididunt ut labore.</p>\n";
+    while (int(body.size()) < options.pageSize) body += filler;
+    body += "</body></html>\n";
+    return body;
+}
+
+static double drawLatency(int host) {
+    double ms = options.latency;
+    if (options.latencyDist == "uniform") ms = uniform_real_distribution<double>(0, 2 * options.latency)(latencyRng);
+    else if (options.latencyDist == "exp" && options.latency > 0) ms = exponential_distribution<double>(1.0 / options.latency)(latencyRng);
+    if (isSlowHost(host)) ms += options.slowLatency;
+    return ms;
+}
+
+//---------------------------------------------------------------------------
+// Value of a header in a lowercase request head, "" if not sent.
+//---------------------------------------------------------------------------
+static string headerValue(const string &lower, const string &name) {
+    size_t pos = lower.find("\r\n" + name + ":");
+    if (pos == string::npos) return "";
+    size_t start = lower.find_first_not_of(' ', pos + name.size() + 3), end = lower.find("\r\n", pos + 2);
+    return start == string::npos || start >= end ? "" : lower.substr(start, end - start);
+}
+
+//---------------------------------------------------------------------------
+// Parse one request head. Return -1 if the host is unknown, else the host number.
+//---------------------------------------------------------------------------
+static int parseRequest(const string &head, Request &request) {
+    size_t lineEnd = head.find("\r\n");
+    string requestLine = head.substr(0, lineEnd);
+    size_t first = requestLine.find(' '), second = requestLine.find(' ', first + 1);
+    request.path = first == string::npos ? "/" : requestLine.substr(first + 1, second - first - 1);
+
+    string lower = head;
+    for (auto &c : lower) c = tolower(c);
+    request.keepAlive = lower.find("connection: close") == string::npos && lower.find("http/1.1") != string::npos;
+    request.acceptEncoding = headerValue(lower, "accept-encoding");
+    request.ifNoneMatch = headerValue(lower, "if-none-match");
+    request.ifModifiedSince = headerValue(lower, "if-modified-since");
+    size_t hostPos = lower.find("\r\nhost:");
+    if (hostPos == string::npos) return -1;
+    size_t valueStart = lower.find_first_not_of(' ', hostPos + 7);
+    if (valueStart == string::npos || lower[valueStart] != 'h') return -1;
+    int host = atoi(lower.c_str() + valueStart + 1);
+    if (lower.compare(valueStart + 1 + to_string(host).size(), 10, ".bench.com") != 0) return -1;
+    return host < options.hosts ? host : -1;
+}
+
+static const char *statusText(int status) {
+    switch (status) {
+        case 200: return "200 OK";
+        case 301: return "301 Moved Permanently";
+        case 304: return "304 Not Modified";
+        default: return "404 Not Found";
+    }
+}
+
+//---------------------------------------------------------------------------
+// Status line, headers & body; the body in 4 KB chunks if chunked, without a
+// length if it ends with the connection.
+//---------------------------------------------------------------------------
+static string buildResponse(int status, const string &body, bool keepAlive, const string &headers = "", bool chunked = false, bool closeDelimited = false) {
+    string head = string("HTTP/1.1 ") + statusText(status) + "\r\nContent-Type: text/html\r\n" + headers;
+    if (status != 304 && !closeDelimited) head += chunked ? string("Transfer-Encoding: chunked\r\n") : "Content-Length: " + to_string(body.size()) + "\r\n";
+    head += keepAlive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+    if (status == 304) return head;
+    if (!chunked) return head + body;
+
+    static const size_t CHUNK_SIZE = 4096;
+    char size[16];
+    for (size_t pos = 0; pos < body.size(); pos += CHUNK_SIZE) {
+        size_t n = min(CHUNK_SIZE, body.size() - pos);
+        snprintf(size, sizeof(size), "%zx\r\n", n);
+        head.append(size).append(body, pos, n).append("\r\n");
+    }
+    return head + "0\r\n\r\n";
+}
+
+//---------------------------------------------------------------------------
+// gzip (zlib header for "deflate") encoded body; "" on failure.
+//---------------------------------------------------------------------------
+static string compress(const string &body, bool gzip) {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, gzip ? 15 + 16 : 15, 8, Z_DEFAULT_STRATEGY) != Z_OK) return "";
+    string encoded(deflateBound(&stream, body.size()) + 32, '\0');
+    stream.next_in = (Bytef *)body.data();
+    stream.avail_in = body.size();
+    stream.next_out = (Bytef *)&encoded[0];
+    stream.avail_out = encoded.size();
+    int result = deflate(&stream, Z_FINISH);
+    encoded.resize(stream.total_out);
+    deflateEnd(&stream);
+    return result == Z_STREAM_END ? encoded : "";
+}
+
+//---------------------------------------------------------------------------
+// Response to a request for host (-1 if unknown). A page ended by the close
+// clears request.keepAlive.
+//---------------------------------------------------------------------------
+static string respond(int host, Request &request) {
+    const string &path = request.path;
+    int page = -1;
+    bool moved = false;
+    if (path == "/" || path == "/index.html") page = 0;
+    else if (path.compare(0, 2, "/p") == 0 || path.compare(0, 2, "/m") == 0) {
+        page = atoi(path.c_str() + 2);
+        moved = path[1] == 'm';
+    }
+    if (host < 0 || page < 0 || page >= options.pages || (moved && !isMovedPage(host, page))) {
+        return buildResponse(404, "not found\n", request.keepAlive);
+    }
+    if (!moved && isMovedPage(host, page)) {
+        return buildResponse(301, "moved\n", request.keepAlive, "Location: /m" + to_string(page) + ".html\r\n");
+    }
+    string headers;
+    if (options.validators) {
+        // A date per version, one day apart; If-Modified-Since must match it exactly
+        int version = pageVersion(host, page);
+        string etag = "\"h" + to_string(host) + "-p" + to_string(page) + "-v" + to_string(version) + "\"";
+        time_t modified = 1700000000 + version * 86400;
+        char date[64];
+        strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", gmtime(&modified));
+        string lowerDate = date;
+        for (auto &c : lowerDate) c = tolower(c);
+        if (request.ifNoneMatch != "" ? request.ifNoneMatch == etag : request.ifModifiedSince == lowerDate) {
+            numNotModified++;
+            return buildResponse(304, "", request.keepAlive, "ETag: " + etag + "\r\n");
+        }
+        headers = "ETag: " + etag + "\r\nLast-Modified: " + date + "\r\n";
+    }
+    string body = renderPage(host, page);
+    if (options.compression) {
+        const string &accepted = request.acceptEncoding;
+        string encoding = accepted.find("gzip") != string::npos ? "gzip" : accepted.find("deflate") != string::npos ? "deflate" : "";
+        string encoded = encoding == "" ? "" : compress(body, encoding == "gzip");
+        if (encoded != "") {
+            body.swap(encoded);
+            headers += "Content-Encoding: " + encoding + "\r\n";
+        }
+    }
+    if (isCloseDelimitedPage(host, page)) {
+        request.keepAlive = false;
+        return buildResponse(200, body, false, headers, false, true);
+    }
+    return buildResponse(200, body, request.keepAlive, headers, isChunkedPage(host, page));
+}
+
+//---------------------------------------------------------------------------
+// Turn the complete requests received on a connection into delayed responses.
+// Return false if the connection must be dropped (failing host).
+//---------------------------------------------------------------------------
+static bool handleRequests(Connection &connection) {
+    size_t headEnd;
+    while ((headEnd = connection.in.find("\r\n\r\n")) != string::npos) {
+        string head = connection.in.substr(0, headEnd + 2);
+        connection.in.erase(0, headEnd + 4);
+        Request request;
+        int host = parseRequest(head, request);
+        numRequests++;
+        if (host >= 0 && isFailingHost(host)) {
+            numFailed++;
+            return false;
+        }
+
+        string response = respond(host, request);
+
+        steady_clock::time_point readyAt = steady_clock::now() + microseconds(int64_t(drawLatency(max(host, 0)) * 1000));
+        if (!connection.delayed.empty()) readyAt = max(readyAt, connection.delayed.back().readyAt);
+        connection.delayed.push_back(DelayedResponse{readyAt, response});
+        if (!request.keepAlive) {
+            connection.closeAfterSend = true;
+            connection.in.clear();
+            break;
+        }
+    }
+    return true;
+}
+
+//---------------------------------------------------------------------------
+// Move the due responses to the output & write as much as the socket takes.
+// Return false once the connection is done.
+//---------------------------------------------------------------------------
+static bool flushConnection(int fd, Connection &connection, int epollFd) {
+    steady_clock::time_point now = steady_clock::now();
+    while (!connection.delayed.empty() && connection.delayed.front().readyAt <= now) {
+        connection.out += connection.delayed.front().data;
+        connection.delayed.pop_front();
+    }
+    while (!connection.out.empty()) {
+        ssize_t n = send(fd, connection.out.data(), connection.out.size(), MSG_NOSIGNAL);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (n <= 0) return false;
+        numBytes += n;
+        connection.out.erase(0, n);
+    }
+    struct epoll_event event;
+    event.events = EPOLLIN | (connection.out.empty() ? 0 : EPOLLOUT);
+    event.data.fd = fd;
+    epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &event);
+    return !(connection.closeAfterSend && connection.out.empty() && connection.delayed.empty());
+}
+
+static void parseArgs(int argc, char *argv[]) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        string name = argv[i], value = argv[i + 1];
+        if (name == "--port") options.port = stoi(value);
+        else if (name == "--hosts") options.hosts = stoi(value);
+        else if (name == "--pages") options.pages = stoi(value);
+        else if (name == "--degree") options.degree = stoi(value);
+        else if (name == "--external-rate") options.externalRate = stod(value);
+        else if (name == "--page-size") options.pageSize = stoi(value);
+        else if (name == "--latency") options.latency = stod(value);
+        else if (name == "--latency-dist") options.latencyDist = value;
+        else if (name == "--slow-rate") options.slowRate = stod(value);
+        else if (name == "--slow-latency") options.slowLatency = stod(value);
+        else if (name == "--fail-rate") options.failRate = stod(value);
+        else if (name == "--seed") options.seed = stoull(value);
+        else if (name == "--chunked-rate") options.chunkedRate = stod(value);
+        else if (name == "--redirect-rate") options.redirectRate = stod(value);
+        else if (name == "--compression") options.compression = stoi(value) != 0;
+        else if (name == "--validators") options.validators = stoi(value) != 0;
+        else if (name == "--change-rate") options.changeRate = stod(value);
+        else if (name == "--generation") options.generation = stoi(value);
+        else if (name == "--close-rate") options.closeRate = stod(value);
+        else {
+            cerr << "Unknown option " << name << endl;
+            exit(1);
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    parseArgs(argc, argv);
+    latencyRng.seed(options.seed);
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    int listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    int one = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(options.port);
+    if (bind(listenFd, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(listenFd, 4096) < 0) {
+        cerr << "Cannot listen on port " << options.port << ": " << strerror(errno) << endl;
+        return 1;
+    }
+
+    int epollFd = epoll_create1(0);
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.fd = listenFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event);
+
+    map<int, Connection> connections;
+    struct epoll_event events[256];
+    while (!stopRequested) {
+        // Sleep until the next delayed response is due
+        int timeout = -1;
+        steady_clock::time_point now = steady_clock::now();
+        for (auto &entry : connections) {
+            if (entry.second.delayed.empty()) continue;
+            int64_t wait = duration_cast<milliseconds>(entry.second.delayed.front().readyAt - now).count() + 1;
+            timeout = timeout < 0 ? int(max<int64_t>(wait, 0)) : min(timeout, int(max<int64_t>(wait, 0)));
+        }
+        int n = epoll_wait(epollFd, events, 256, timeout);
+        if (n < 0 && errno != EINTR) break;
+
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            if (fd == listenFd) {
+                int clientFd;
+                while ((clientFd = accept4(listenFd, NULL, NULL, SOCK_NONBLOCK)) >= 0) {
+                    setsockopt(clientFd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                    struct epoll_event clientEvent;
+                    clientEvent.events = EPOLLIN;
+                    clientEvent.data.fd = clientFd;
+                    epoll_ctl(epollFd, EPOLL_CTL_ADD, clientFd, &clientEvent);
+                    connections[clientFd] = Connection();
+                    numConnections++;
+                }
+                continue;
+            }
+
+            Connection &connection = connections[fd];
+            bool alive = true;
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                char buffer[16384];
+                ssize_t received;
+                while ((received = recv(fd, buffer, sizeof(buffer), 0)) > 0) connection.in.append(buffer, received);
+                if (received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) alive = false;
+                if (alive) alive = handleRequests(connection);
+            }
+            if (alive) alive = flushConnection(fd, connection, epollFd);
+            if (!alive) {
+                close(fd);
+                connections.erase(fd);
+            }
+        }
+
+        // Responses whose latency is over
+        now = steady_clock::now();
+        for (auto it = connections.begin(); it != connections.end(); ) {
+            if (!it->second.delayed.empty() && it->second.delayed.front().readyAt <= now && !flushConnection(it->first, it->second, epollFd)) {
+                close(it->first);
+                it = connections.erase(it);
+            } else it++;
+        }
+    }
+
+    cout << "requests " << numRequests << " bytes " << numBytes << " connections " << numConnections << " failed " << numFailed
+         << " notModified " << numNotModified << endl;
+    return 0;
+}
@@ -0,0 +1,101 @@
+//---------------------------------------------------------------------------
+// C++ Implementation file for the receive buffers, recycled across pages and hosts.
+//---------------------------------------------------------------------------
+
+#include "bufferPool.h"
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+//---------------------------------------------------------------------------
+// RecvBuffer constructor
+//---------------------------------------------------------------------------
+RecvBuffer::RecvBuffer(size_t capacity) {
+    this->size = max(capacity, size_t(1));
+    this->storage.reset(new char[size]);
+    this->writePos = 0;
+}
+
+char *RecvBuffer::writeBegin() { return storage.get() + writePos; }
+size_t RecvBuffer::writableBytes() const { return size - writePos; }
+size_t RecvBuffer::capacity() const { return size; }
+
+void RecvBuffer::commit(size_t length) {
+    writePos += min(length, writableBytes());
+}
+
+//---------------------------------------------------------------------------
+// The received bytes not consumed yet, without copying them.
+//---------------------------------------------------------------------------
+string_view RecvBuffer::readable() const {
+    return string_view(storage.get(), writePos);
+}
+
+void RecvBuffer::clear() {
+    writePos = 0;
+}
+
+//---------------------------------------------------------------------------
+// Per thread free list, buffers are deleted when the thread exits.
+//---------------------------------------------------------------------------
+struct FreeList {
+    vector<RecvBuffer *> buffers;
+    ~FreeList() {
+        for (auto buffer : buffers) delete buffer;
+    }
+};
+static thread_local FreeList freeList;
+
+//---------------------------------------------------------------------------
+// The process-wide pool.
+//---------------------------------------------------------------------------
+BufferPool &BufferPool::instance() {
+    static BufferPool pool;
+    return pool;
+}
+
+BufferPool::BufferPool() {
+    bufferSize = 65536;
+    maxFreePerThread = 16;
+    allocated = reused = 0;
+}
+
+void BufferPool::configure(size_t bufferSize, size_t maxFreePerThread) {
+    this->bufferSize = bufferSize;
+    this->maxFreePerThread = maxFreePerThread;
+}
+
+//---------------------------------------------------------------------------
+// Get an empty buffer, from this thread's free list if possible.
+//---------------------------------------------------------------------------
+RecvBuffer *BufferPool::acquire() {
+    if (!freeList.buffers.empty()) {
+        RecvBuffer *buffer = freeList.buffers.back();
+        freeList.buffers.pop_back();
+        reused++;
+        return buffer;
+    }
+    allocated++;
+    return new RecvBuffer(bufferSize);
+}
+
+//---------------------------------------------------------------------------
+// Give a buffer back. Buffers larger than the configured size are not kept.
+//---------------------------------------------------------------------------
+void BufferPool::release(RecvBuffer *buffer) {
+    if (buffer == NULL) return;
+    if (freeList.buffers.size() >= maxFreePerThread || buffer->capacity() > bufferSize) {
+        delete buffer;
+        return;
+    }
+    buffer->clear();
+    freeList.buffers.push_back(buffer);
+}
+
+BufferPoolStats BufferPool::getStats() {
+    BufferPoolStats stats;
+    stats.allocated = allocated;
+    stats.reused = reused;
+    return stats;
+}
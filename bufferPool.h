@@ -0,0 +1,50 @@
+//---------------------------------------------------------------------------
+// Header File for the receive buffers, recycled across pages and hosts.
+//---------------------------------------------------------------------------
+
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <string_view>
+#include <memory>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+using namespace std;
+
+// Fixed size byte buffer: data is received at the write end, read whole & cleared.
+class RecvBuffer {
+    public:
+        explicit RecvBuffer(size_t capacity);
+        char *writeBegin();
+        size_t writableBytes() const;
+        void commit(size_t length);
+        string_view readable() const;
+        void clear();
+        size_t capacity() const;
+    private:
+        unique_ptr<char[]> storage;
+        size_t size, writePos;
+};
+
+typedef struct {
+    uint64_t allocated = 0;                             // buffers created
+    uint64_t reused = 0;                                // buffers handed out again from a free list
+} BufferPoolStats;
+
+// Free lists are kept per thread, so event loops never contend for buffers.
+class BufferPool {
+    public:
+        static BufferPool &instance();
+        void configure(size_t bufferSize, size_t maxFreePerThread);
+        RecvBuffer *acquire();
+        void release(RecvBuffer *buffer);
+        BufferPoolStats getStats();
+    private:
+        BufferPool();
+        atomic<size_t> bufferSize, maxFreePerThread;
+        atomic<uint64_t> allocated, reused;
+};
+
+#endif
@@ -0,0 +1,124 @@
+//---------------------------------------------------------------------------
+// C++ Implementation file for crawl checkpoints, the state needed to resume a crawl.
+// A checkpoint is written to a temporary file & renamed over the previous one,
+// so a crash while writing leaves the previous checkpoint intact. The file is
+// synced before the rename & the directory after it, so the new name never
+// points to data still in the page cache.
+//---------------------------------------------------------------------------
+
+#include "checkpoint.h"
+#include "serialize.h"
+#include "urlDedup.h"
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+
+using namespace std;
+
+static const char MAGIC[] = "CRAWLCP2";
+
+//---------------------------------------------------------------------------
+// fsync the directory of path, making a rename in it durable.
+//---------------------------------------------------------------------------
+static string syncDirectory(const string &path) {
+    size_t slash = path.rfind('/');
+    string directory = slash == string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    int fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0) return "Cannot open " + directory + "!";
+    bool synced = fsync(fd) == 0;
+    close(fd);
+    return synced ? "" : "Cannot sync " + directory + "!";
+}
+
+//---------------------------------------------------------------------------
+// Write the checkpoint; the body ends with its fingerprint to detect damaged files.
+// Return an error message, empty on success.
+//---------------------------------------------------------------------------
+string writeCheckpoint(const string &path, const CheckpointData &data) {
+    string body;
+    appendU64(body, data.frontier.tasks.size());
+    for (auto &task : data.frontier.tasks) {
+        appendString(body, task.hostname);
+        appendU64(body, uint64_t(task.depth));
+    }
+    appendU64(body, data.frontier.segments.size());
+    for (auto &segment : data.frontier.segments) {
+        appendString(body, segment.name);
+        appendU64(body, segment.readOffset);
+        appendU64(body, segment.endOffset);
+        appendU64(body, segment.unread);
+    }
+    appendString(body, data.discoveredSites);
+    appendU64(body, data.totals.sites);
+    appendU64(body, data.totals.pages);
+    appendU64(body, data.totals.pagesFailed);
+    appendU64(body, data.totals.linkedSites);
+    appendDouble(body, data.totals.totalResponseTime);
+    appendDouble(body, data.totals.minResponseTime);
+    appendDouble(body, data.totals.maxResponseTime);
+    appendU64(body, data.outputBytes);
+    appendU64(body, fingerprint(body));
+
+    string tempPath = path + ".tmp";
+    int fd = open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return "Cannot create " + tempPath + "!";
+    string content = string(MAGIC, sizeof(MAGIC) - 1) + body;
+    size_t written = 0;
+    while (written < content.size()) {
+        ssize_t n = write(fd, content.data() + written, content.size() - written);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        written += n;
+    }
+    bool synced = written == content.size() && fsync(fd) == 0;
+    close(fd);
+    if (!synced) return "Cannot write " + tempPath + "!";
+    if (rename(tempPath.c_str(), path.c_str()) != 0) return "Cannot rename " + tempPath + "!";
+    return syncDirectory(path);
+}
+
+//---------------------------------------------------------------------------
+// Read a checkpoint. Return an error message, empty on success.
+//---------------------------------------------------------------------------
+string readCheckpoint(const string &path, CheckpointData &data) {
+    ifstream file(path, ios::binary);
+    if (!file) return "Cannot open " + path + "!";
+    stringstream content;
+    content << file.rdbuf();
+    string raw = content.str();
+
+    string_view in(raw);
+    size_t magicLength = sizeof(MAGIC) - 1;
+    if (in.size() < magicLength + 8 || in.substr(0, magicLength) != MAGIC) return path + " is not a checkpoint!";
+    in.remove_prefix(magicLength);
+    string_view body = in.substr(0, in.size() - 8), tail = in.substr(in.size() - 8);
+    uint64_t checksum;
+    if (!readU64(tail, checksum) || checksum != fingerprint(body)) return path + " is damaged!";
+
+    uint64_t numTasks, numSegments, depth;
+    if (!readU64(body, numTasks)) return path + " is damaged!";
+    data.frontier.tasks.clear();
+    for (uint64_t i = 0; i < numTasks; i++) {
+        SiteTask task;
+        if (!readString(body, task.hostname) || !readU64(body, depth)) return path + " is damaged!";
+        task.depth = int(depth);
+        data.frontier.tasks.push_back(task);
+    }
+    if (!readU64(body, numSegments)) return path + " is damaged!";
+    data.frontier.segments.clear();
+    for (uint64_t i = 0; i < numSegments; i++) {
+        SpillSegment segment;
+        if (!readString(body, segment.name) || !readU64(body, segment.readOffset) ||
+            !readU64(body, segment.endOffset) || !readU64(body, segment.unread)) return path + " is damaged!";
+        data.frontier.segments.push_back(segment);
+    }
+    if (!readString(body, data.discoveredSites) || !readU64(body, data.totals.sites) ||
+        !readU64(body, data.totals.pages) || !readU64(body, data.totals.pagesFailed) ||
+        !readU64(body, data.totals.linkedSites) || !readDouble(body, data.totals.totalResponseTime) ||
+        !readDouble(body, data.totals.minResponseTime) || !readDouble(body, data.totals.maxResponseTime) ||
+        !readU64(body, data.outputBytes)) return path + " is damaged!";
+    return "";
+}
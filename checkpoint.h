@@ -0,0 +1,35 @@
+//---------------------------------------------------------------------------
+// Header File for crawl checkpoints, the state needed to resume a crawl.
+//---------------------------------------------------------------------------
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "frontier.h"
+#include <string>
+#include <cstdint>
+
+using namespace std;
+
+// Statistics of the sites already finished, summed up.
+typedef struct {
+    uint64_t sites = 0;                                 // websites finished
+    uint64_t pages = 0;                                 // pages discovered
+    uint64_t pagesFailed = 0;                           // pages failed to discover
+    uint64_t linkedSites = 0;                           // linked sites found
+    double totalResponseTime = 0;                       // ms, over all the pages
+    double minResponseTime = -1;                        // ms
+    double maxResponseTime = -1;                        // ms
+} CrawlTotals;
+
+typedef struct {
+    FrontierSnapshot frontier;                          // waiting & in progress sites
+    string discoveredSites;                             // ShardedSet::save of the seen sites
+    CrawlTotals totals;
+    uint64_t outputBytes = 0;                           // of the output file, holding the finished sites
+} CheckpointData;
+
+string writeCheckpoint(const string &path, const CheckpointData &data);
+string readCheckpoint(const string &path, CheckpointData &data);
+
+#endif
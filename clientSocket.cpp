@@ -4,9 +4,18 @@
 
 #include "clientSocket.h"
 #include "parser.h"
-#include <netdb.h>
+#include "urlFilter.h"
+#include "dnsResolver.h"
+#include "bufferPool.h"
+#include "corpus.h"
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
 #include <unistd.h>
+#include <cerrno>
+#include <climits>
 #include <chrono>
+#include <algorithm>
 
 using namespace std;
 using namespace std::chrono;
@@ -14,165 +23,650 @@ using namespace std::chrono;
 //---------------------------------------------------------------------------
 // ClientSocket constructor
 //---------------------------------------------------------------------------
-ClientSocket::ClientSocket(string hostname, int port, int pagesLimit, int crawlDelay) {
-    this->pagesLimit = pagesLimit;
+ClientSocket::ClientSocket(EventLoop *loop, PolitenessScheduler *scheduler, string hostname, const FetchOptions &options) : options(options), discoveredPages(options.dedup), discoveredLinkedSites(options.dedup), requestTokens(scheduler->delayFor(hostname), options.hostBurst) {
+    this->loop = loop;
+    this->scheduler = scheduler;
     this->hostname = hostname;
-    this->port = port;
-    this->pendingPages.push("/");
-    this->discoveredPages["/"] = true;
-    this->crawlDelay = crawlDelay;
-    this->discoveredLinkedSites.clear();
+    this->pendingPages.push_back("/");
+    this->discoveredPages.insert("/");
+    if (options.linkGraph) graphPage("/");
+    this->stats.hostname = hostname;
+    auto limit = options.hostConnections.find(hostname);
+    this->maxConnections = max(limit != options.hostConnections.end() ? limit->second : options.connectionsPerHost, 1);
+    this->connectionWindow = options.adaptiveConcurrency ? 1 : maxConnections;
+    this->waitingForToken = false;
+    this->dispatching = false;
+    this->redispatch = false;
+}
+
+ClientSocket::~ClientSocket() {
+    for (auto &connection : connections) {
+        if (connection->timeoutTimer) loop->cancelTimer(connection->timeoutTimer);
+        this->closeConnection(*connection);
+    }
+}
+
+ClientSocket::Connection::Connection(ClientSocket *site) {
+    this->site = site;
+    this->sock = -1;
+    this->socketsOpened = 0;
+    this->connected = false;
+    this->responsesOnConnection = 0;
+    this->bytesSent = 0;
+    this->timeoutTimer = 0;
+    this->headersChecked = false;
+    this->extractBody = false;
+    this->parser.setMaxBodySize(site->options.maxBodySize);
+    this->parser.setBodyHandler([this](string_view body) { this->site->receiveBody(*this, body); });
+    this->decoder.setMaxDecodedSize(site->options.maxDecodedSize);
+    this->contentHash = PageCache::EMPTY_HASH;
+}
+
+void ClientSocket::Connection::handleEvent(uint32_t events) {
+    site->handleEvent(*this, events);
 }
 
 //---------------------------------------------------------------------------
-// Create a socket & connect to the hostname with well-known port 80.
+// Create a non-blocking socket & start connecting to the resolved host address.
 // Return Error Description if failed or "" if successed.
 //---------------------------------------------------------------------------
-string ClientSocket::startConnection() {
-    // Variables
-    struct hostent *host;
-    struct sockaddr_in server_addr;     
-
-    // Get host address by hostname
-    host = gethostbyname(hostname.c_str());
-    if (host == NULL || host->h_addr == NULL) {
-        return "Error getting DNS info!";
-    }
+string ClientSocket::startConnection(Connection &connection, struct in_addr address) {
+    struct sockaddr_in server_addr = {};
+    int &sock = connection.sock;
 
     // Create Socket structure
-    if ((sock = socket(AF_INET, SOCK_STREAM, 0)) == -1) {
+    if ((sock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) == -1) {
         return "Cannot create socket!";
     }
-    bzero(&server_addr, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;     
-    server_addr.sin_port = htons(port);
-    server_addr.sin_addr = *((struct in_addr *)host->h_addr);
-    bzero(&(server_addr.sin_zero),8); 
+    connection.socketsOpened++;
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(options.port);
+    server_addr.sin_addr = address;
 
-    // Connect to server
-    if (connect(sock, (struct sockaddr *)&server_addr, sizeof(struct sockaddr)) == -1) {
+    // Connect to server, completion is reported as writable by the loop
+    int result = connect(sock, (struct sockaddr *)&server_addr, sizeof(server_addr));
+    if (result == -1 && errno != EINPROGRESS) {
+        this->closeConnection(connection);
         return "Cannot connect to server!";
     }
+    if (!loop->addFd(sock, EPOLLOUT, &connection)) {
+        this->closeConnection(connection);
+        return "Cannot watch socket!";
+    }
 
+    connection.connected = false;
+    connection.responsesOnConnection = 0;
+    resetResponse(connection);
+    connection.connectStartTime = steady_clock::now();
+    Metrics::instance().countConnection(1);
     return "";
 }
 
 //---------------------------------------------------------------------------
-// Disconnect, slose the socket.
+// Disconnect, close the socket.
+//---------------------------------------------------------------------------
+string ClientSocket::closeConnection(Connection &connection) {
+    if (connection.sock == -1) return "";
+    Metrics::instance().countConnection(-1);
+    loop->removeFd(connection.sock);
+    int result = close(connection.sock);
+    connection.sock = -1;
+    connection.connected = false;
+    connection.sendData = "";
+    connection.bytesSent = 0;
+    connection.extractor.reset();
+    return result == 0 ? "" : "Cannot close socket!";
+}
+
+//---------------------------------------------------------------------------
+// Append an HTTP GET request to the data to send
+//---------------------------------------------------------------------------
+void ClientSocket::appendHttpRequest(string &request, string_view path, const CachedPage *cached) {
+    request.append("GET ").append(path).append(" HTTP/1.1\r\n");
+    request.append("HOST:").append(hostname).append("\r\n");
+    if (options.compression) request += "Accept-Encoding: gzip, deflate\r\n";
+    // A page of the previous crawl is only sent again if it changed
+    if (cached && cached->etag != "") request.append("If-None-Match: ").append(cached->etag).append("\r\n");
+    if (cached && cached->lastModified != "") request.append("If-Modified-Since: ").append(cached->lastModified).append("\r\n");
+    request += options.keepAlive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+}
+
+//---------------------------------------------------------------------------
+// Discover the website. onFinished is called on the loop thread with the stats.
 //---------------------------------------------------------------------------
-string ClientSocket::closeConnection() {
-    try {
-        close(sock);
-    } catch ( exception &error ) {
-        return error.what();
+void ClientSocket::startDiscovering(function<void(SiteStats&)> onFinished) {
+    this->onFinished = onFinished;
+    fetchNextPages();
+}
+
+//---------------------------------------------------------------------------
+// Give the waiting pages to the idle connections, one batch per token of the
+// host. Finish once nothing is requested & nothing is left to request, or the
+// max-page limit is reached.
+//---------------------------------------------------------------------------
+void ClientSocket::fetchNextPages() {
+    // A connection failing at once calls back here: the outer call goes on instead
+    if (dispatching) {
+        redispatch = true;
+        return;
     }
-    return "";
+    dispatching = true;
+    do {
+        redispatch = false;
+        while (!waitingForToken) {
+            int count = pagesAllowed();
+            Connection *connection = count > 0 ? idleConnection() : NULL;
+            if (connection == NULL) break;
+
+            // Wait for the host's next token; the loop serves other hosts meanwhile
+            if (!requestTokens.take()) {
+                waitingForToken = true;
+                scheduler->schedule(requestTokens.waitTime(), [this] {
+                    waitingForToken = false;
+                    fetchNextPages();
+                });
+                break;
+            }
+            for (int i = 0; i < count; i++) {
+                InFlightPage page;
+                page.path = pendingPages.front();
+                page.sent = false;
+                page.responseTime = -1;
+                page.parseNanos = 0;
+                pendingPages.pop_front();
+                if (PageCache::instance().isOpen()) {
+                    page.cached = make_shared<CachedPage>();
+                    if (!PageCache::instance().lookup(hostname + string(page.path), *page.cached)) page.cached.reset();
+                }
+                connection->inFlight.push_back(page);
+            }
+            sendRequests(*connection);
+        }
+    } while (redispatch);
+    dispatching = false;
+
+    if (waitingForToken) return;
+    for (auto &connection : connections) {
+        if (!connection->inFlight.empty()) return;
+    }
+    finishDiscovering();
+}
+
+//---------------------------------------------------------------------------
+// Pages for the next batch: up to pipelineDepth, never more than the pages
+// still allowed for the site once the ones in flight are answered.
+//---------------------------------------------------------------------------
+int ClientSocket::pagesAllowed() const {
+    int pagesLeft = INT_MAX;
+    if (options.pagesLimit != -1) {
+        pagesLeft = options.pagesLimit - int(stats.discoveredPages.size());
+        for (auto &connection : connections) pagesLeft -= int(connection->inFlight.size());
+    }
+    return max(min(min(max(options.pipelineDepth, 1), pagesLeft), int(pendingPages.size())), 0);
 }
 
 //---------------------------------------------------------------------------
-// Create HTTP GET request
+// A connection without requests, an open one first. A new one is added while
+// the host has less than its connections; NULL if the window is full.
 //---------------------------------------------------------------------------
-string ClientSocket::createHttpRequest(string host, string path) {
-    string request = "";
-    request += "GET " + path + " HTTP/1.1\r\n";
-    request += "HOST:" + host + "\r\n";
-    request += "Connection: close\r\n\r\n";
-    return request;
+ClientSocket::Connection *ClientSocket::idleConnection() {
+    Connection *idle = NULL;
+    int busy = 0;
+    for (auto &connection : connections) {
+        if (!connection->inFlight.empty()) busy++;
+    }
+    if (busy >= int(connectionWindow)) return NULL;
+    for (auto &connection : connections) {
+        if (!connection->inFlight.empty()) continue;
+        if (connection->sock != -1) return connection.get();
+        if (idle == NULL) idle = connection.get();
+    }
+    if (idle == NULL && int(connections.size()) < maxConnections) {
+        connections.push_back(unique_ptr<Connection>(new Connection(this)));
+        idle = connections.back().get();
+    }
+    return idle;
 }
 
 //---------------------------------------------------------------------------
-// Discover the website. Ignore failed requests(sends)
+// Send the connection's pages, on its open socket if there is one. Otherwise get
+// the host address first, from the shared DNS cache or asynchronously.
 //---------------------------------------------------------------------------
-SiteStats ClientSocket::startDiscovering() {
-    SiteStats stats;
-    stats.hostname = hostname;
+void ClientSocket::sendRequests(Connection &connection) {
+    if (connection.sock != -1) {
+        writeRequests(connection);
+        return;
+    }
+
+    connection.dnsStartTime = steady_clock::now();
+    DnsResolver &resolver = DnsResolver::instance();
+    bool found;
+    struct in_addr address;
+    if (resolver.lookup(hostname, found, address)) {
+        onHostResolved(connection, found, address);
+    } else {
+        EventLoop *loop = this->loop;
+        Connection *target = &connection;
+        resolver.resolve(hostname, [this, loop, target](bool found, struct in_addr address) {
+            loop->post([this, target, found, address] { onHostResolved(*target, found, address); });
+        });
+    }
+}
+
+void ClientSocket::onHostResolved(Connection &connection, bool found, struct in_addr address) {
+    recordPhase(PHASE_DNS, connection.dnsStartTime, steady_clock::now());
+    // Cannot create connection, simply ignore the page.
+    if (!found || this->startConnection(connection, address) != "") {
+        connection.inFlight.pop_front();
+        stats.numberOfPagesFailed++;
+        Metrics::instance().countFailure(found ? FAIL_CONNECT : FAIL_DNS);
+        requeuePages(connection);
+        fetchNextPages();
+        return;
+    }
+    writeRequests(connection);
+}
 
-    // While still have pages to discover & not exceed the max-page limit for a site.
-    while (!pendingPages.empty() && (pagesLimit == -1 || int(stats.discoveredPages.size()) < pagesLimit)) {
-        // Next page to fetch
-        string path = pendingPages.front();
-        pendingPages.pop();
+//---------------------------------------------------------------------------
+// Send the requests of the connection's pages once the socket is connected.
+//---------------------------------------------------------------------------
+void ClientSocket::writeRequests(Connection &connection) {
+    high_resolution_clock::time_point startTime = high_resolution_clock::now();
+    for (auto &page : connection.inFlight) {
+        page.startTime = startTime;
+        appendHttpRequest(connection.sendData, page.path, page.cached.get());
+    }
+    Metrics::instance().countRequests(connection.inFlight.size());
+    Connection *target = &connection;
+    connection.timeoutTimer = loop->runAfter(milliseconds(options.pageTimeout), [this, target] {
+        target->timeoutTimer = 0;
+        connectionLost(*target, FAIL_TIMEOUT);
+    });
 
-        // Sleep for crawlDelay if this is not the first request
-        if (path != "/") usleep(crawlDelay);
+    // A reused connection can be written right away
+    if (connection.connected) {
+        loop->modifyFd(connection.sock, EPOLLIN | EPOLLOUT, &connection);
+        onWritable(connection);
+    }
+}
 
-        // Clock Start
-        high_resolution_clock::time_point startTime = high_resolution_clock::now();
+//---------------------------------------------------------------------------
+// Socket event from the loop: connect result, room to send, or data to read.
+//---------------------------------------------------------------------------
+void ClientSocket::handleEvent(Connection &connection, uint32_t events) {
+    if (!connection.connected || (connection.bytesSent < connection.sendData.size() && (events & EPOLLOUT))) onWritable(connection);
+    if (connection.sock != -1 && connection.connected && (events & (EPOLLIN | EPOLLHUP | EPOLLERR))) onReadable(connection);
+}
 
-        // Cannot create connection, simply ignore.
-        if (this->startConnection() != "") {
-            stats.numberOfPagesFailed++;
-            continue;
+void ClientSocket::onWritable(Connection &connection) {
+    // Connection result is known once the socket is writable
+    if (!connection.connected) {
+        int error = 0;
+        socklen_t len = sizeof(error);
+        if (getsockopt(connection.sock, SOL_SOCKET, SO_ERROR, &error, &len) == -1 || error != 0) {
+            connectionLost(connection, FAIL_CONNECT);
+            return;
         }
+        connection.connected = true;
+        recordPhase(PHASE_CONNECT, connection.connectStartTime, steady_clock::now());
+    }
 
-        // send GET resquest
-        string send_data = createHttpRequest(hostname, path);
-        if (send(sock, send_data.c_str(), strlen(send_data.c_str()), 0) < 0) {
+    // send GET resquests
+    string &sendData = connection.sendData;
+    while (connection.bytesSent < sendData.size()) {
+        ssize_t n = send(connection.sock, sendData.data() + connection.bytesSent, sendData.size() - connection.bytesSent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return;
             // Send failed. Note it and continue.
-            stats.numberOfPagesFailed++;
-            continue;
+            connectionLost(connection, FAIL_SEND);
+            return;
         }
-        
-        // get HTTP response from server  
-        char recv_data[1024];
-        int totalBytesRead = 0;
-        string httpResponse = "";
-        double responseTime = -1;
-        while (true) {
-            bzero(recv_data, sizeof(recv_data));
-            int bytesRead = recv(sock, recv_data, sizeof(recv_data), 0);
-
-            // Get response time when first receive
-            if (responseTime < -0.5) {
-                // Clock End
-                high_resolution_clock::time_point endTime = high_resolution_clock::now();
-                responseTime = duration<double, milli>(endTime - startTime).count();
-            }
+        connection.bytesSent += n;
+        Metrics::instance().addBytesSent(n);
+    }
+    // The requests written are now waiting for their first byte
+    steady_clock::time_point now = steady_clock::now();
+    for (auto &page : connection.inFlight) {
+        if (!page.sent) page.sentTime = now;
+        page.sent = true;
+    }
+    sendData = "";
+    connection.bytesSent = 0;
+    loop->modifyFd(connection.sock, EPOLLIN, &connection);
+}
 
-            // Check Data Received.
-            if (bytesRead > 0) {
-                string ss(recv_data);
-                httpResponse += ss;
-                totalBytesRead += bytesRead;
-            } else {
-                break;
+void ClientSocket::onReadable(Connection &connection) {
+    // get HTTP responses from server, straight into a pooled buffer
+    // A completed response may close the socket and fetchNextPages() open a new
+    // one on this connection, with the same fd: stop reading once it happens.
+    RecvBuffer *buffer = BufferPool::instance().acquire();
+    int opened = connection.socketsOpened;
+    while (connection.sock != -1 && connection.socketsOpened == opened) {
+        ssize_t bytesRead = recv(connection.sock, buffer->writeBegin(), buffer->writableBytes(), 0);
+        if (bytesRead > 0) {
+            // Parser & extractor work on the received slice, nothing is kept afterwards
+            buffer->commit(bytesRead);
+            Metrics::instance().addBytesReceived(bytesRead);
+            processData(connection, buffer->readable());
+            buffer->clear();
+        } else if (bytesRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else {
+            // Closed by the server: ends a response framed by the close
+            if (!connection.inFlight.empty()) {
+                connection.parser.finishOnClose();
+                if (connection.parser.isComplete()) completeResponse(connection);
             }
+            if (connection.sock != -1 && connection.socketsOpened == opened) connectionLost(connection, FAIL_RECV);
+            break;
+        }
+    }
+    BufferPool::instance().release(buffer);
+}
+
+//---------------------------------------------------------------------------
+// Split the received bytes into responses, in the order the pages were requested.
+//---------------------------------------------------------------------------
+void ClientSocket::processData(Connection &connection, string_view data) {
+    HttpResponseParser &parser = connection.parser;
+    int opened = connection.socketsOpened;
+    while (!data.empty() && connection.sock != -1 && connection.socketsOpened == opened) {
+        // Nothing was requested, ignore the data.
+        if (connection.inFlight.empty()) return;
+
+        // Get response time when first receive
+        InFlightPage &page = connection.inFlight.front();
+        if (page.responseTime < -0.5) {
+            // Clock End
+            high_resolution_clock::time_point endTime = high_resolution_clock::now();
+            page.responseTime = duration<double, milli>(endTime - page.startTime).count();
+            page.firstByteTime = steady_clock::now();
+            recordPhase(PHASE_TTFB, page.sent ? page.sentTime : page.firstByteTime, page.firstByteTime);
         }
 
-        // Close connection. Ingore the error as data is received anyway.
-        this->closeConnection();
+        steady_clock::time_point parseStart = steady_clock::now();
+        size_t used = parser.feed(data);
+        if (CorpusRecorder::instance().isOpen()) connection.recorded.append(data.data(), used);
+        data.remove_prefix(used);
+        page.parseNanos += duration_cast<nanoseconds>(steady_clock::now() - parseStart).count();
 
+        if (parser.hasError()) {
+            connectionLost(connection, FAIL_PARSE);
+            return;
+        }
+        if (parser.hasHeaders() && !connection.headersChecked) checkHeaders(connection);
+        if (parser.isComplete()) completeResponse(connection);
+    }
+}
+
+//---------------------------------------------------------------------------
+// Headers of a response are in: only a successful HTML page is read & parsed.
+// Other bodies (redirects, errors, images, archives...) are skipped, cutting
+// the connection if they are large.
+//---------------------------------------------------------------------------
+void ClientSocket::checkHeaders(Connection &connection) {
+    HttpResponseParser &parser = connection.parser;
+    connection.headersChecked = true;
+    int status = parser.getStatusCode();
+    string type = parser.getContentType();
+    bool &extractBody = connection.extractBody;
+    extractBody = status >= 200 && status < 300 && (type.empty() || type.find("html") != string::npos);
+
+    // An encoded body is inflated on the way to the extractor; an unknown encoding can't be read.
+    string encoding = parser.getHeader("content-encoding");
+    transform(encoding.begin(), encoding.end(), encoding.begin(), ::tolower);
+    if (extractBody && encoding != "" && encoding != "identity" && !connection.decoder.start(encoding)) extractBody = false;
+    if (!extractBody) parser.skipBody();
+}
+
+//---------------------------------------------------------------------------
+// Body bytes of a wanted page. A corrupt or too large encoded body stops the response.
+//---------------------------------------------------------------------------
+void ClientSocket::receiveBody(Connection &connection, string_view body) {
+    if (!connection.extractBody) return;
+    if (!connection.decoder.isActive()) {
+        parseBody(connection, body);
+        return;
+    }
+    if (!connection.decoder.feed(body, [this, &connection](string_view decoded) { parseBody(connection, decoded); })) connection.parser.skipBody();
+}
+
+void ClientSocket::parseBody(Connection &connection, string_view body) {
+    if (PageCache::instance().isOpen()) connection.contentHash = updateContentHash(connection.contentHash, body);
+    connection.extractor.feed(body);
+}
+
+//---------------------------------------------------------------------------
+// Forget the response being received.
+//---------------------------------------------------------------------------
+void ClientSocket::resetResponse(Connection &connection) {
+    connection.parser.reset();
+    connection.decoder.end();
+    connection.contentHash = PageCache::EMPTY_HASH;
+    connection.recorded.clear();
+    connection.headersChecked = connection.extractBody = false;
+}
+
+//---------------------------------------------------------------------------
+// A response is complete, save the page & extract its URLs.
+//---------------------------------------------------------------------------
+void ClientSocket::completeResponse(Connection &connection) {
+    HttpResponseParser &parser = connection.parser;
+    ContentDecoder &decoder = connection.decoder;
+    bool extractBody = connection.extractBody;
+    InFlightPage page = connection.inFlight.front();
+    connection.inFlight.pop_front();
+    connection.responsesOnConnection++;
+    steady_clock::time_point completeTime = steady_clock::now();
+    recordPhase(PHASE_TRANSFER, page.firstByteTime, completeTime);
+    Metrics::instance().countResponse(parser.getStatusCode());
+    if (CorpusRecorder::instance().isOpen()) CorpusRecorder::instance().record(hostname, page.path, connection.recorded);
+
+    int status = parser.getStatusCode();
+    string location = parser.getHeader("location");
+    // Cut at maxBodySize, or inflated up to maxDecodedSize: only the start of the page was read
+    bool truncated = parser.isTruncated() || (decoder.isActive() && decoder.isFull());
+    if (truncated) Metrics::instance().countTruncated();
+    if (decoder.isActive()) {
+        stats.bytesCompressed += decoder.getEncodedSize();
+        stats.bytesDecompressed += decoder.getDecodedSize();
+    }
+    bool notModified = status == 304 && page.cached;
+    if (decoder.isActive() && decoder.hasError()) {
+        stats.numberOfPagesFailed++;
+        Metrics::instance().countFailure(FAIL_PARSE);
+    } else if (notModified) {
+        stats.discoveredPages.push_back(make_pair(page.path, page.responseTime));
+        stats.numberOfPagesUnchanged++;
+        PageCache::instance().countNotModified();
+    } else if (status >= 300 && status < 400 && location != "") {
+        stats.numberOfRedirects++;
+        Metrics::instance().countRedirect();
+        followRedirect(location, page.path);
+    } else if (status >= 200 && status < 300 && !extractBody) {
+        stats.numberOfPagesSkipped++;
+        Metrics::instance().countSkipped();
+    } else if (!extractBody) {
+        stats.numberOfPagesFailed++;
+        Metrics::instance().countFailure(FAIL_STATUS);
+    } else {
         // Save to discoveredPages
-        stats.discoveredPages.push_back(make_pair(hostname+path, responseTime));
-
-        // Extract URLs from the received data.
-        vector< pair<string, string> > extractedUrls = extractUrls(httpResponse);
-        for (auto url : extractedUrls) {
-            if (url.first == "" || url.first == hostname) {
-                // Case 1: In the same host. Check if the path is discovered
-                if (!discoveredPages[url.second]) {
-                    pendingPages.push(url.second);
-                    discoveredPages[url.second] = true;
-                }
-            } else {
-                // Case 2: In a different host, add to linkedSites
-                if (!discoveredLinkedSites[url.first]) { 
-                    discoveredLinkedSites[url.first] = true;
-                    stats.linkedSites.push_back(url.first);
-                }
+        stats.discoveredPages.push_back(make_pair(page.path, page.responseTime));
+    }
+    adaptConnections(status >= 500 || status == 429 || decoder.hasError() || page.responseTime > options.slowResponseTime);
+
+    // URLs were extracted while the body was received, or are the ones of the previous crawl.
+    // They are views into the extractor's page table: only the new ones are copied, into the site's arena.
+    connection.extractor.finish();
+    const vector< pair<string_view, string_view> > *extractedUrls = &connection.extractor.getUrls();
+    vector< pair<string_view, string_view> > cachedUrls;
+    if (notModified) {
+        for (auto &url : page.cached->links) cachedUrls.push_back(make_pair(string_view(url.first), string_view(url.second)));
+        extractedUrls = &cachedUrls;
+    }
+    if (extractBody && !truncated && !decoder.hasError() && PageCache::instance().isOpen()) cachePage(connection, page, *extractedUrls);
+    for (auto &url : *extractedUrls) {
+        if (url.first == "" || url.first == hostname) {
+            // Case 1: In the same host. Check if the path is discovered
+            if (discoveredPages.insert(url.second)) addPage(url.second);
+            if (options.linkGraph) stats.graphLinks.push_back(make_pair(graphPage(page.path), graphPage(url.second)));
+        } else {
+            // Case 2: In a different host, add to linkedSites
+            if (discoveredLinkedSites.insert(url.first)) {
+                stats.linkedSites.push_back(stats.strings->store(url.first));
             }
         }
     }
+    connection.extractor.clearUrls();
+    page.parseNanos += duration_cast<nanoseconds>(steady_clock::now() - completeTime).count();
+    recordPhase(PHASE_PARSE, completeTime, completeTime + nanoseconds(page.parseNanos));
+
+    // The server won't answer more on this connection: ask again later for the rest.
+    bool keepAlive = options.keepAlive && parser.isKeepAlive();
+    resetResponse(connection);
+    if (!keepAlive) {
+        requeuePages(connection);
+        this->closeConnection(connection);
+    }
+
+    if (connection.inFlight.empty()) {
+        if (connection.timeoutTimer) loop->cancelTimer(connection.timeoutTimer);
+        connection.timeoutTimer = 0;
+    }
+    // New pages may keep the other connections busy too
+    fetchNextPages();
+}
 
-    // Calculate Stats
+//---------------------------------------------------------------------------
+// Keep the metadata of a fully read page for the next crawl, unless it is already cached.
+//---------------------------------------------------------------------------
+void ClientSocket::cachePage(Connection &connection, const InFlightPage &page, const vector< pair<string_view, string_view> > &links) {
+    CachedPage cached;
+    cached.etag = connection.parser.getHeader("etag");
+    cached.lastModified = connection.parser.getHeader("last-modified");
+    cached.contentHash = connection.contentHash;
+    if (page.cached && page.cached->contentHash == cached.contentHash) {
+        stats.numberOfPagesUnchanged++;
+        PageCache::instance().countUnchanged();
+        if (page.cached->etag == cached.etag && page.cached->lastModified == cached.lastModified) return;
+    }
+    for (auto &link : links) cached.links.push_back(make_pair(string(link.first), string(link.second)));
+    PageCache::instance().store(hostname + string(page.path), cached);
+}
+
+//---------------------------------------------------------------------------
+// Location of a redirect: a page of this host is fetched like a link, another
+// host goes to the linked sites (and so to the frontier).
+//---------------------------------------------------------------------------
+void ClientSocket::followRedirect(string location, string_view basePath) {
+    // Same normalization as the extracted links: lowercase, no query or fragment
+    location = location.substr(0, location.find_first_of("?#"));
+    transform(location.begin(), location.end(), location.begin(), ::tolower);
+    if (location.compare(0, 2, "//") == 0) location = "http:" + location;
+
+    string_view host = hostname, path;
+    if (location.compare(0, 7, "http://") == 0 || location.compare(0, 8, "https://") == 0) {
+        splitUrl(location, host, path);
+        if (!UrlFilter::instance().accept(host, path)) return;
+    } else {
+        if (location.compare(0, 1, "/") != 0) location = string(basePath.substr(0, basePath.rfind('/') + 1)) + location;
+        path = location;
+        if (!UrlFilter::instance().accept("", path)) return;
+    }
+    if (host.empty()) return;
+
+    if (host == hostname) {
+        if (discoveredPages.insert(path)) addPage(path);
+        if (options.linkGraph) stats.graphLinks.push_back(make_pair(graphPage(basePath), graphPage(path)));
+    } else if (discoveredLinkedSites.insert(host)) {
+        stats.linkedSites.push_back(stats.strings->store(host));
+    }
+}
+
+//---------------------------------------------------------------------------
+// A page of this host seen for the first time waits to be fetched.
+//---------------------------------------------------------------------------
+void ClientSocket::addPage(string_view path) {
+    pendingPages.push_back(options.linkGraph ? stats.graphPages[graphPage(path)] : stats.strings->store(path));
+}
+
+//---------------------------------------------------------------------------
+// Number of the page in the link graph of the host, given at its first sight.
+//---------------------------------------------------------------------------
+uint32_t ClientSocket::graphPage(string_view path) {
+    auto found = pageNumbers.find(path);
+    if (found != pageNumbers.end()) return found->second;
+    string_view stored = stats.strings->store(path);
+    stats.graphPages.push_back(stored);
+    pageNumbers[stored] = uint32_t(stats.graphPages.size() - 1);
+    return uint32_t(stats.graphPages.size() - 1);
+}
+
+//---------------------------------------------------------------------------
+// Connecting, sending or receiving failed, or timed out. The page being received
+// is failed; pages not answered yet are requested again if the connection was reused.
+//---------------------------------------------------------------------------
+void ClientSocket::connectionLost(Connection &connection, FailureCause cause) {
+    bool reused = connection.responsesOnConnection > 0;
+    bool started = connection.parser.isStarted();
+    this->closeConnection(connection);
+    resetResponse(connection);
+    if (connection.inFlight.empty()) return;
+
+    if (connection.timeoutTimer) loop->cancelTimer(connection.timeoutTimer);
+    connection.timeoutTimer = 0;
+    if (started || !reused) {
+        stats.numberOfPagesFailed++;
+        Metrics::instance().countFailure(cause);
+        connection.inFlight.pop_front();
+    }
+    Metrics::instance().countRetries(connection.inFlight.size());
+    requeuePages(connection);
+    adaptConnections(true);
+    fetchNextPages();
+}
+
+//---------------------------------------------------------------------------
+// AIMD on the connections of the host: a fast answer adds 1/window (one more
+// connection per window of them), an overloaded host gets half of them.
+//---------------------------------------------------------------------------
+void ClientSocket::adaptConnections(bool overloaded) {
+    if (!options.adaptiveConcurrency) return;
+    if (overloaded) connectionWindow = max(connectionWindow / 2, 1.0);
+        else connectionWindow = min(connectionWindow + 1 / connectionWindow, double(maxConnections));
+}
+
+//---------------------------------------------------------------------------
+// Put the connection's pages back in front of the waiting ones, in order.
+//---------------------------------------------------------------------------
+void ClientSocket::requeuePages(Connection &connection) {
+    while (!connection.inFlight.empty()) {
+        pendingPages.push_front(connection.inFlight.back().path);
+        connection.inFlight.pop_back();
+    }
+}
+
+//---------------------------------------------------------------------------
+// Time of a fetch phase, into the host's & the global histograms.
+//---------------------------------------------------------------------------
+void ClientSocket::recordPhase(FetchPhase phase, steady_clock::time_point start, steady_clock::time_point end) {
+    uint64_t micros = uint64_t(max<int64_t>(duration_cast<microseconds>(end - start).count(), 0));
+    stats.phases[phase].record(micros);
+    Metrics::instance().recordPhase(phase, micros);
+}
+
+//---------------------------------------------------------------------------
+// Calculate Stats & report them.
+//---------------------------------------------------------------------------
+void ClientSocket::finishDiscovering() {
     double totalResponseTime = 0;
     for (auto page : stats.discoveredPages) {
         totalResponseTime += page.second;
         stats.minResponseTime = stats.minResponseTime < 0 ? page.second : min(stats.minResponseTime, page.second);
         stats.maxResponseTime = stats.maxResponseTime < 0 ? page.second : max(stats.maxResponseTime, page.second);
     }
-    if (!stats.discoveredPages.empty()) 
+    if (!stats.discoveredPages.empty())
         stats.averageResponseTime = totalResponseTime / stats.discoveredPages.size();
 
-    return stats;
+    onFinished(stats);
 }
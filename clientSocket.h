@@ -5,10 +5,25 @@
 #ifndef CLIENTSOCKET_H
 #define CLIENTSOCKET_H
 
+#include "eventLoop.h"
+#include "politeness.h"
+#include "httpParser.h"
+#include "linkExtractor.h"
+#include "contentDecoder.h"
+#include "pageCache.h"
+#include "urlDedup.h"
+#include "stringArena.h"
+#include "metrics.h"
+#include <netinet/in.h>
 #include <string>
-#include <queue>
+#include <string_view>
+#include <deque>
 #include <vector>
 #include <map>
+#include <unordered_map>
+#include <chrono>
+#include <functional>
+#include <memory>
 
 using namespace std;
 
@@ -18,23 +33,134 @@ typedef struct {
     double minResponseTime = -1;                        // response time stats
     double maxResponseTime = -1;                        /////
     int numberOfPagesFailed = 0;                        // number of pages that are failed to discover
-    vector<string> linkedSites;                         // linked sites
-    vector< pair<string, double> > discoveredPages;     // list of pages that are discovered, with response time
+    int numberOfPagesSkipped = 0;                       // answers that are not HTML pages, not read to the end
+    int numberOfRedirects = 0;                          // answers redirecting to another page or site
+    int numberOfPagesUnchanged = 0;                     // pages as they were at the previous crawl (304 or same content)
+    uint64_t bytesCompressed = 0;                       // gzip/deflate bodies as received
+    uint64_t bytesDecompressed = 0;                     // the same bodies once inflated
+    shared_ptr<StringArena> strings = make_shared<StringArena>();   // holds linkedSites & the paths of discoveredPages
+    vector<string_view> linkedSites;                    // linked sites
+    vector< pair<string_view, double> > discoveredPages;    // paths of the pages that are discovered, with response time
+    vector<string_view> graphPages;                     // link graph only: every page seen, numbered by position
+    vector< pair<uint32_t, uint32_t> > graphLinks;      // link graph only: links between the pages of the host, by number
+    HostHistogram phases[NUM_PHASES];                   // time of each fetch phase (us)
 } SiteStats;
 
+// Fetch settings shared by all the sockets of a crawl, owned by the FetchEngine.
+typedef struct {
+    int port = 80;
+    int pagesLimit = -1;                                // max pages per site, -1 for no limit
+    int crawlDelay = 1000;                              // ms between requests to the same host
+    map<string, int> hostDelays;                        // crawlDelay overrides for specific hosts
+    int pageTimeout = 30000;                            // ms, time limit for one request batch
+    int connectionsPerHost = 1;                         // connections fetching the pages of a host in parallel
+    map<string, int> hostConnections;                   // connectionsPerHost overrides for specific hosts
+    int hostBurst = 1;                                  // request batches a host may get at once after waiting
+    bool adaptiveConcurrency = true;                    // AIMD on the connections used, up to connectionsPerHost
+    int slowResponseTime = 1000;                        // ms, a slower answer makes the host use less connections
+    bool keepAlive = true;                              // reuse one connection for all pages of the host
+    size_t maxBodySize = 0;                             // bytes of a page read at most, 0 for no limit
+    bool compression = false;                           // ask for gzip/deflate bodies
+    size_t maxDecodedSize = 0;                          // bytes of an inflated page kept at most, 0 for no limit
+    int pipelineDepth = 1;                              // max requests sent before their responses arrive
+    DedupOptions dedup;                                 // sets of the pages & linked sites seen on the host
+    bool linkGraph = false;                             // number the pages & keep the links between them
+} FetchOptions;
+
+// Non-blocking discoverer of one website, driven by an EventLoop. The pages
+// waiting on the host are shared by up to connectionsPerHost connections; each
+// request batch takes a token from the host's bucket, one every crawlDelay ms.
+// With adaptiveConcurrency, the connections used start at one and follow AIMD:
+// fast answers add one per window, slow answers & errors halve them.
+// Everything runs on the loop thread, so the stats need no lock.
 class ClientSocket {
     public:
-        ClientSocket(string hostname, int port=80, int pagesLimit=-1, int crawlDelay=1000);
-        SiteStats startDiscovering();
+        ClientSocket(EventLoop *loop, PolitenessScheduler *scheduler, string hostname, const FetchOptions &options);
+        ~ClientSocket();
+        void startDiscovering(function<void(SiteStats&)> onFinished);
     private:
+        // A page requested on the connection, waiting for its response
+        typedef struct {
+            string_view path;                           // in stats.strings
+            chrono::high_resolution_clock::time_point startTime;
+            chrono::steady_clock::time_point sentTime;  // request fully written
+            chrono::steady_clock::time_point firstByteTime;
+            bool sent;
+            double responseTime;
+            uint64_t parseNanos;                        // time in the parser & extractor
+            shared_ptr<CachedPage> cached;              // from the previous crawl, NULL if none
+        } InFlightPage;
+
+        // One connection to the host & the response being received on it
+        class Connection : public EventHandler {
+            public:
+                Connection(ClientSocket *site);
+                void handleEvent(uint32_t events);
+
+                ClientSocket *site;
+                int sock;
+                int socketsOpened;                      // tells a reopened socket from the one being read
+                bool connected;
+                int responsesOnConnection;
+                string sendData;
+                size_t bytesSent;
+                deque<InFlightPage> inFlight;           // pages given to this connection
+                HttpResponseParser parser;
+                bool headersChecked, extractBody;       // of the response being received
+                ContentDecoder decoder;
+                uint64_t contentHash;
+                string recorded;                        // bytes of the response, when recording a corpus
+                LinkExtractor extractor;
+                uint64_t timeoutTimer;
+                chrono::steady_clock::time_point dnsStartTime, connectStartTime;
+        };
+
+        EventLoop *loop;
+        PolitenessScheduler *scheduler;
         string hostname;
-        int sock, pagesLimit, port, crawlDelay;
-        queue<string> pendingPages;
-        map<string, bool> discoveredPages;
-        map<string, bool> discoveredLinkedSites;
-        string startConnection();
-        string closeConnection();
-        string createHttpRequest(string host, string path);
+        const FetchOptions &options;
+        deque<string_view> pendingPages;                // in stats.strings
+        UrlDedup discoveredPages;
+        UrlDedup discoveredLinkedSites;
+        unordered_map<string_view, uint32_t> pageNumbers;   // link graph only: stats.graphPages by path
+        SiteStats stats;
+        function<void(SiteStats&)> onFinished;
+
+        // Connections & the rate limit of the host
+        vector< unique_ptr<Connection> > connections;
+        int maxConnections;
+        double connectionWindow;                        // connections that may be busy at once
+        TokenBucket requestTokens;
+        bool waitingForToken;
+        bool dispatching, redispatch;                   // fetchNextPages running / called again meanwhile
+
+        void fetchNextPages();
+        int pagesAllowed() const;
+        Connection *idleConnection();
+        void sendRequests(Connection &connection);
+        void onHostResolved(Connection &connection, bool found, struct in_addr address);
+        void writeRequests(Connection &connection);
+        void handleEvent(Connection &connection, uint32_t events);
+        void onWritable(Connection &connection);
+        void onReadable(Connection &connection);
+        void processData(Connection &connection, string_view data);
+        void checkHeaders(Connection &connection);
+        void receiveBody(Connection &connection, string_view body);
+        void parseBody(Connection &connection, string_view body);
+        void resetResponse(Connection &connection);
+        void completeResponse(Connection &connection);
+        void cachePage(Connection &connection, const InFlightPage &page, const vector< pair<string_view, string_view> > &links);
+        void followRedirect(string location, string_view basePath);
+        void addPage(string_view path);
+        uint32_t graphPage(string_view path);
+        void connectionLost(Connection &connection, FailureCause cause);
+        void requeuePages(Connection &connection);
+        void adaptConnections(bool overloaded);
+        void recordPhase(FetchPhase phase, chrono::steady_clock::time_point start, chrono::steady_clock::time_point end);
+        void finishDiscovering();
+        string startConnection(Connection &connection, struct in_addr address);
+        string closeConnection(Connection &connection);
+        void appendHttpRequest(string &request, string_view path, const CachedPage *cached);
 };
 
 #endif
@@ -0,0 +1,119 @@
+//---------------------------------------------------------------------------
+// C++ Implementation file for the content decoder, streaming gzip/deflate inflation.
+// zlib keeps a 32 KB window per stream, so it only lives while a body is decoded.
+// The decoded size is capped: a few KB of zeros can inflate to gigabytes.
+//---------------------------------------------------------------------------
+
+#include "contentDecoder.h"
+#include <cstring>
+
+using namespace std;
+
+// Decoded data goes through this buffer; one per event loop thread.
+static const size_t OUTPUT_SIZE = 65536;
+static thread_local unsigned char output[OUTPUT_SIZE];
+
+//---------------------------------------------------------------------------
+// ContentDecoder constructor
+//---------------------------------------------------------------------------
+ContentDecoder::ContentDecoder() {
+    memset(&stream, 0, sizeof(stream));
+    active = initialized = rawDeflate = error = full = finished = false;
+    maxDecodedSize = 0;
+    encodedSize = decodedSize = 0;
+}
+
+ContentDecoder::~ContentDecoder() {
+    end();
+}
+
+void ContentDecoder::setMaxDecodedSize(size_t maxDecodedSize) {
+    this->maxDecodedSize = maxDecodedSize;
+}
+
+//---------------------------------------------------------------------------
+// Get ready for a body with the given Content-Encoding (lowercase).
+// Return false if the encoding is not supported.
+//---------------------------------------------------------------------------
+bool ContentDecoder::start(const string &encoding) {
+    end();
+    if (encoding != "gzip" && encoding != "x-gzip" && encoding != "deflate") return false;
+    active = true;
+    rawDeflate = encoding == "deflate";
+    error = full = finished = false;
+    encodedSize = decodedSize = 0;
+    return true;
+}
+
+//---------------------------------------------------------------------------
+// zlib is set up on the first bytes: "deflate" should be zlib-wrapped, but
+// some servers send a raw deflate stream, told apart by the zlib header check.
+//---------------------------------------------------------------------------
+bool ContentDecoder::initialize(string_view data) {
+    int windowBits = 15 + 32;                           // gzip or zlib header, detected
+    if (rawDeflate) {
+        unsigned char cmf = data[0], flg = data.size() > 1 ? data[1] : 0;
+        bool zlibHeader = (cmf & 0x0f) == 8 && (cmf >> 4) <= 7 && (data.size() < 2 || (cmf * 256 + flg) % 31 == 0);
+        if (zlibHeader) windowBits = 15;
+            else windowBits = -15;
+    }
+    memset(&stream, 0, sizeof(stream));
+    if (inflateInit2(&stream, windowBits) != Z_OK) return false;
+    initialized = true;
+    return true;
+}
+
+//---------------------------------------------------------------------------
+// Inflate a piece of the body, the decoded data goes to onDecoded. Return false
+// once the data is corrupt or the decoded size reached its limit.
+//---------------------------------------------------------------------------
+bool ContentDecoder::feed(string_view data, const function<void(string_view)> &onDecoded) {
+    if (!active || error || full) return false;
+    encodedSize += data.size();
+    if (finished || data.empty()) return true;          // bytes after the end of the stream are ignored
+    if (!initialized && !initialize(data)) {
+        error = true;
+        return false;
+    }
+
+    stream.next_in = (Bytef *)data.data();
+    stream.avail_in = data.size();
+    do {
+        stream.next_out = output;
+        stream.avail_out = OUTPUT_SIZE;
+        int result = inflate(&stream, Z_NO_FLUSH);
+        if (result != Z_OK && result != Z_STREAM_END && result != Z_BUF_ERROR) {
+            error = true;
+            return false;
+        }
+
+        size_t produced = OUTPUT_SIZE - stream.avail_out;
+        if (maxDecodedSize > 0 && decodedSize + produced > maxDecodedSize) {
+            produced = maxDecodedSize - decodedSize;
+            full = true;
+        }
+        if (produced > 0) onDecoded(string_view((const char *)output, produced));
+        decodedSize += produced;
+        if (full) return false;
+        if (result == Z_STREAM_END) {
+            finished = true;
+            break;
+        }
+        if (result == Z_BUF_ERROR) break;
+    } while (stream.avail_in > 0 || stream.avail_out == 0);    // a full buffer may leave output in zlib
+    return true;
+}
+
+//---------------------------------------------------------------------------
+// The response is done, free the zlib state.
+//---------------------------------------------------------------------------
+void ContentDecoder::end() {
+    if (initialized) inflateEnd(&stream);
+    initialized = active = error = full = false;
+}
+
+bool ContentDecoder::isActive() const { return active; }
+bool ContentDecoder::hasError() const { return error; }
+bool ContentDecoder::isFull() const { return full; }
+size_t ContentDecoder::getEncodedSize() const { return encodedSize; }
+size_t ContentDecoder::getDecodedSize() const { return decodedSize; }
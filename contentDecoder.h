@@ -0,0 +1,39 @@
+//---------------------------------------------------------------------------
+// Header File for the content decoder, streaming gzip/deflate inflation of response bodies.
+//---------------------------------------------------------------------------
+
+#ifndef CONTENTDECODER_H
+#define CONTENTDECODER_H
+
+#include <zlib.h>
+#include <string>
+#include <string_view>
+#include <functional>
+#include <cstddef>
+
+using namespace std;
+
+// One encoded body at a time: start() with its Content-Encoding, feed() the
+// body as it arrives, end() when the response is done.
+class ContentDecoder {
+    public:
+        ContentDecoder();
+        ~ContentDecoder();
+        void setMaxDecodedSize(size_t maxDecodedSize);
+        bool start(const string &encoding);
+        bool feed(string_view data, const function<void(string_view)> &onDecoded);
+        void end();
+        bool isActive() const;
+        bool hasError() const;
+        bool isFull() const;
+        size_t getEncodedSize() const;
+        size_t getDecodedSize() const;
+    private:
+        z_stream stream;
+        bool active, initialized, rawDeflate, error, full, finished;
+        size_t maxDecodedSize;      // 0 for no limit
+        size_t encodedSize, decodedSize;
+        bool initialize(string_view data);
+};
+
+#endif
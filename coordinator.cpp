@@ -0,0 +1,212 @@
+//---------------------------------------------------------------------------
+// C++ Implementation file for the coordinator, which runs one crawler process per shard of the hostnames.
+// The crawl is over when every worker reported no unfinished site and has
+// taken in every batch routed to it: a worker sends its found sites before its
+// status, so no site can still be on its way.
+//---------------------------------------------------------------------------
+
+#include "coordinator.h"
+#include "shardLink.h"
+#include "serialize.h"
+#include <cerrno>
+#include <cstdlib>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+using namespace std;
+
+//---------------------------------------------------------------------------
+// Coordinator constructor
+//---------------------------------------------------------------------------
+Coordinator::Coordinator(int numShards) {
+    this->numShards = numShards;
+    this->outputFd = -1;
+    this->stopping = false;
+}
+
+Coordinator::~Coordinator() {
+    for (auto &worker : workers) {
+        if (!worker.closed) close(worker.fd);
+    }
+    if (outputFd != -1 && outputFd != STDOUT_FILENO) close(outputFd);
+}
+
+//---------------------------------------------------------------------------
+// Fork the workers; runWorker is the whole crawl of one shard, in the child.
+// Return Error Description or "".
+//---------------------------------------------------------------------------
+string Coordinator::start(function<int(int shard, int fd)> runWorker) {
+    for (int shard = 0; shard < numShards; shard++) {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) return "Cannot create the socket of shard " + to_string(shard) + "!";
+        pid_t pid = fork();
+        if (pid == -1) return "Cannot start shard " + to_string(shard) + "!";
+        if (pid == 0) {
+            close(fds[0]);
+            for (auto &worker : workers) close(worker.fd);
+            exit(runWorker(shard, fds[1]));
+        }
+        close(fds[1]);
+        fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+        Worker worker;
+        worker.pid = pid;
+        worker.fd = fds[0];
+        worker.statusSeen = worker.done = worker.closed = false;
+        worker.unfinished = worker.received = worker.sent = 0;
+        workers.push_back(worker);
+    }
+    return "";
+}
+
+//---------------------------------------------------------------------------
+// Route messages until every worker hung up, then reap them.
+// Return Error Description or "".
+//---------------------------------------------------------------------------
+string Coordinator::run(const string &format, const string &outputPath) {
+    if (outputPath == "") outputFd = STDOUT_FILENO;
+        else outputFd = open(outputPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (outputFd == -1) {
+        stopAll();
+        error = "Cannot open " + outputPath + "!";
+    } else if (format == "binary") {
+        writeOutput("CRAWLRS1");
+    }
+
+    while (true) {
+        vector<struct pollfd> entries;
+        vector<int> shards;
+        for (int shard = 0; shard < numShards; shard++) {
+            Worker &worker = workers[shard];
+            if (worker.closed) continue;
+            entries.push_back({worker.fd, short(POLLIN | (worker.out.empty() ? 0 : POLLOUT)), 0});
+            shards.push_back(shard);
+        }
+        if (entries.empty()) break;
+        if (poll(entries.data(), entries.size(), -1) < 0) {
+            if (errno == EINTR) continue;
+            error = "Cannot poll the shards!";
+            break;
+        }
+        for (size_t i = 0; i < entries.size(); i++) {
+            if (entries[i].revents & POLLOUT) writeWorker(shards[i]);
+            if ((entries[i].revents & (POLLIN | POLLHUP | POLLERR)) && !readWorker(shards[i])) {
+                Worker &worker = workers[shards[i]];
+                close(worker.fd);
+                worker.closed = true;
+                if (!worker.done && !stopping) {
+                    error = "Shard " + to_string(shards[i]) + " stopped before the end of the crawl!";
+                    stopAll();
+                }
+            }
+        }
+        if (!stopping && allIdle()) stopAll();
+    }
+
+    for (auto &worker : workers) {
+        int status;
+        if (waitpid(worker.pid, &status, 0) == worker.pid && (!WIFEXITED(status) || WEXITSTATUS(status) != 0) && error.empty()) {
+            error = "A shard process failed!";
+        }
+    }
+    return error;
+}
+
+//---------------------------------------------------------------------------
+// Read what the worker sent & handle the complete messages. False once it hung up.
+//---------------------------------------------------------------------------
+bool Coordinator::readWorker(int shard) {
+    Worker &worker = workers[shard];
+    char chunk[65536];
+    bool open = true;
+    while (true) {
+        ssize_t n = read(worker.fd, chunk, sizeof(chunk));
+        if (n > 0) {
+            worker.in.append(chunk, n);
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) open = false;
+        break;
+    }
+
+    string_view in(worker.in), payload;
+    uint64_t type;
+    while (readMessage(in, type, payload)) handleMessage(shard, type, payload);
+    worker.in.erase(0, worker.in.size() - in.size());
+    return open;
+}
+
+void Coordinator::writeWorker(int shard) {
+    Worker &worker = workers[shard];
+    while (!worker.out.empty()) {
+        ssize_t n = write(worker.fd, worker.out.data(), worker.out.size());
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        worker.out.erase(0, n);
+    }
+}
+
+void Coordinator::handleMessage(int shard, uint64_t type, string_view payload) {
+    Worker &worker = workers[shard];
+    if (type == MSG_SITES) {
+        // Sent on as is, without the target
+        string_view sites = payload;
+        uint64_t target;
+        if (!readU64(sites, target) || target >= uint64_t(numShards) || workers[target].closed) return;
+        appendMessage(workers[target].out, MSG_SITES, sites);
+        workers[target].sent++;
+        writeWorker(int(target));
+    } else if (type == MSG_OUTPUT) {
+        writeOutput(payload);
+    } else if (type == MSG_STATUS) {
+        string_view status = payload;
+        if (!readU64(status, worker.unfinished) || !readU64(status, worker.received)) return;
+        worker.statusSeen = true;
+    } else if (type == MSG_DONE) {
+        CrawlTotals shardTotals;
+        if (!decodeTotals(payload, shardTotals)) return;
+        worker.done = true;
+        totals.sites += shardTotals.sites;
+        totals.pages += shardTotals.pages;
+        totals.pagesFailed += shardTotals.pagesFailed;
+        totals.linkedSites += shardTotals.linkedSites;
+        totals.totalResponseTime += shardTotals.totalResponseTime;
+        if (shardTotals.minResponseTime >= 0 && (totals.minResponseTime < 0 || shardTotals.minResponseTime < totals.minResponseTime)) totals.minResponseTime = shardTotals.minResponseTime;
+        if (shardTotals.maxResponseTime > totals.maxResponseTime) totals.maxResponseTime = shardTotals.maxResponseTime;
+    }
+}
+
+void Coordinator::writeOutput(string_view data) {
+    if (outputFd == -1) return;
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t n = write(outputFd, data.data() + done, data.size() - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        done += n;
+    }
+}
+
+bool Coordinator::allIdle() const {
+    for (auto &worker : workers) {
+        if (worker.closed) continue;
+        if (!worker.statusSeen || worker.unfinished > 0 || worker.received != worker.sent) return false;
+    }
+    return true;
+}
+
+void Coordinator::stopAll() {
+    stopping = true;
+    for (int shard = 0; shard < numShards; shard++) {
+        if (workers[shard].closed) continue;
+        appendMessage(workers[shard].out, MSG_STOP, "");
+        writeWorker(shard);
+    }
+}
+
+CrawlTotals Coordinator::getTotals() const {
+    return totals;
+}
@@ -0,0 +1,53 @@
+//---------------------------------------------------------------------------
+// Header File for the coordinator, which runs one crawler process per shard of the hostnames.
+//---------------------------------------------------------------------------
+
+#ifndef COORDINATOR_H
+#define COORDINATOR_H
+
+#include "checkpoint.h"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <functional>
+#include <cstdint>
+#include <sys/types.h>
+
+using namespace std;
+
+// Forks the workers, each connected by a Unix socket pair; routes the sites they
+// find to the owning shard, writes their output & stops them all once every
+// shard is idle with no site in transit.
+class Coordinator {
+    public:
+        Coordinator(int numShards);
+        ~Coordinator();
+        string start(function<int(int shard, int fd)> runWorker);
+        string run(const string &format, const string &outputPath);
+        CrawlTotals getTotals() const;
+    private:
+        typedef struct {
+            pid_t pid;
+            int fd;
+            string in, out;                             // bytes received & still to send
+            bool statusSeen, done, closed;
+            uint64_t unfinished;                        // from the last status
+            uint64_t received;                          // SITES messages taken in, from the last status
+            uint64_t sent;                              // SITES messages routed to the worker
+        } Worker;
+
+        int numShards;
+        vector<Worker> workers;
+        CrawlTotals totals;
+        int outputFd;
+        bool stopping;
+        string error;
+        void handleMessage(int shard, uint64_t type, string_view payload);
+        bool readWorker(int shard);
+        void writeWorker(int shard);
+        void writeOutput(string_view data);
+        bool allIdle() const;
+        void stopAll();
+};
+
+#endif
@@ -0,0 +1,231 @@
+//---------------------------------------------------------------------------
+// C++ Implementation file for the response corpus, its recorder & its reader.
+//---------------------------------------------------------------------------
+
+#include "corpus.h"
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <ctime>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+// The buffers are written once they hold this much.
+static const size_t WRITE_BATCH = 1 << 20;
+
+static const string RECORD_START = "WARC/1.0\r\n";
+static const string HEADER_END = "\r\n\r\n";
+
+CorpusRecorder &CorpusRecorder::instance() {
+    static CorpusRecorder recorder;
+    return recorder;
+}
+
+CorpusRecorder::CorpusRecorder() {
+    fd = indexFd = -1;
+    fileSize = 0;
+    records = 0;
+}
+
+CorpusRecorder::~CorpusRecorder() {
+    close();
+}
+
+//---------------------------------------------------------------------------
+// Open the corpus & its index to append to them. Return Error Description or "".
+//---------------------------------------------------------------------------
+string CorpusRecorder::open(const string &path) {
+    this->path = path;
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd == -1) return "Cannot open " + path + "!";
+    indexFd = ::open((path + ".idx").c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (indexFd == -1) return "Cannot open " + path + ".idx!";
+    struct stat info;
+    if (fstat(fd, &info) != 0) return "Cannot read " + path + "!";
+    fileSize = info.st_size;
+    return "";
+}
+
+//---------------------------------------------------------------------------
+// Write what is buffered & close the files. Return Error Description or "".
+//---------------------------------------------------------------------------
+string CorpusRecorder::close() {
+    if (fd == -1) return "";
+    lock_guard<mutex> lock(writeMutex);
+    string error = flushLocked();
+    ::close(fd);
+    if (indexFd != -1) ::close(indexFd);
+    fd = indexFd = -1;
+    return error;
+}
+
+bool CorpusRecorder::isOpen() const {
+    return fd != -1;
+}
+
+//---------------------------------------------------------------------------
+// Append a response as it was received for http://hostname + path.
+//---------------------------------------------------------------------------
+void CorpusRecorder::record(string_view hostname, string_view path, string_view response) {
+    if (fd == -1) return;
+    char date[32];
+    time_t now = time(NULL);
+    struct tm utc;
+    gmtime_r(&now, &utc);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", &utc);
+    string uri = "http://" + string(hostname) + string(path);
+    string header = RECORD_START + "WARC-Type: response\r\nWARC-Target-URI: " + uri + "\r\nWARC-Date: " + date
+        + "\r\nContent-Type: application/http; msgtype=response\r\nContent-Length: " + to_string(response.size()) + HEADER_END;
+
+    lock_guard<mutex> lock(writeMutex);
+    indexBuffer += uri + " " + to_string(fileSize + header.size()) + " " + to_string(response.size()) + "\n";
+    writeBuffer += header;
+    writeBuffer.append(response.data(), response.size());
+    writeBuffer += HEADER_END;
+    fileSize += header.size() + response.size() + HEADER_END.size();
+    records++;
+    if (writeBuffer.size() >= WRITE_BATCH) flushLocked();
+}
+
+uint64_t CorpusRecorder::getRecords() const {
+    return records;
+}
+
+//---------------------------------------------------------------------------
+// The records before their index lines, so the index never points past the corpus.
+//---------------------------------------------------------------------------
+string CorpusRecorder::flushLocked() {
+    string error;
+    for (int i = 0; i < 2; i++) {
+        string &buffer = i == 0 ? writeBuffer : indexBuffer;
+        int out = i == 0 ? fd : indexFd;
+        size_t written = 0;
+        while (written < buffer.size()) {
+            ssize_t n = write(out, buffer.data() + written, buffer.size() - written);
+            if (n <= 0) {
+                error = "Cannot write " + path + (i == 0 ? "!" : ".idx!");
+                break;
+            }
+            written += n;
+        }
+        buffer.clear();
+    }
+    return error;
+}
+
+//---------------------------------------------------------------------------
+// CorpusReader constructor
+//---------------------------------------------------------------------------
+CorpusReader::CorpusReader() {
+    this->data = NULL;
+    this->size = 0;
+    this->bytes = 0;
+}
+
+CorpusReader::~CorpusReader() {
+    close();
+}
+
+//---------------------------------------------------------------------------
+// Map a corpus & list its records. Return Error Description or "".
+//---------------------------------------------------------------------------
+string CorpusReader::open(const string &path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return "Cannot open " + path + "!";
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        ::close(fd);
+        return path + " is empty!";
+    }
+    void *mapped = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) return "Cannot map " + path + "!";
+    data = (const char *)mapped;
+    size = info.st_size;
+    if (!readIndex(path + ".idx") && !scanRecords()) {
+        close();
+        return path + " is not a corpus!";
+    }
+    for (auto &record : records) bytes += record.response.size();
+    return "";
+}
+
+void CorpusReader::close() {
+    if (data) munmap((void *)data, size);
+    data = NULL;
+    size = 0;
+    records.clear();
+    uris.clear();
+    bytes = 0;
+}
+
+const vector<CorpusRecord> &CorpusReader::getRecords() const {
+    return records;
+}
+
+uint64_t CorpusReader::getBytes() const {
+    return bytes;
+}
+
+//---------------------------------------------------------------------------
+// Records from the index; false if it is missing or doesn't match the corpus.
+//---------------------------------------------------------------------------
+bool CorpusReader::readIndex(const string &indexPath) {
+    ifstream file(indexPath, ios::binary);
+    if (!file) return false;
+    stringstream content;
+    content << file.rdbuf();
+    uris = content.str();
+
+    string_view lines(uris);
+    while (!lines.empty()) {
+        size_t end = lines.find('\n');
+        string_view line = lines.substr(0, end);
+        lines.remove_prefix(end == string_view::npos ? lines.size() : end + 1);
+        size_t lengthStart = line.rfind(' ');
+        size_t offsetStart = lengthStart == string_view::npos || lengthStart == 0 ? string_view::npos : line.rfind(' ', lengthStart - 1);
+        if (offsetStart == string_view::npos) return false;
+        uint64_t offset = strtoull(string(line.substr(offsetStart + 1, lengthStart - offsetStart - 1)).c_str(), NULL, 10);
+        uint64_t length = strtoull(string(line.substr(lengthStart + 1)).c_str(), NULL, 10);
+        if (offset > size || length > size - offset) return false;
+        records.push_back(CorpusRecord{line.substr(0, offsetStart), string_view(data + offset, length)});
+    }
+    return !records.empty();
+}
+
+//---------------------------------------------------------------------------
+// Records from the WARC headers themselves, when there is no usable index.
+//---------------------------------------------------------------------------
+bool CorpusReader::scanRecords() {
+    records.clear();
+    string_view corpus(data, size);
+    size_t pos = 0;
+    while (pos < corpus.size()) {
+        if (corpus.compare(pos, RECORD_START.size(), RECORD_START) != 0) return false;
+        size_t headerEnd = corpus.find(HEADER_END, pos);
+        if (headerEnd == string_view::npos) return false;
+        string_view header = corpus.substr(pos, headerEnd - pos), uri;
+        uint64_t length = 0;
+        bool hasLength = false;
+        while (!header.empty()) {
+            size_t end = header.find("\r\n");
+            string_view line = header.substr(0, end);
+            header.remove_prefix(end == string_view::npos ? header.size() : end + 2);
+            if (line.compare(0, 17, "WARC-Target-URI: ") == 0) uri = line.substr(17);
+            if (line.compare(0, 16, "Content-Length: ") == 0) {
+                length = strtoull(string(line.substr(16)).c_str(), NULL, 10);
+                hasLength = true;
+            }
+        }
+        size_t start = headerEnd + HEADER_END.size();
+        if (!hasLength || length > corpus.size() - start) return false;
+        records.push_back(CorpusRecord{uri, corpus.substr(start, length)});
+        pos = start + length + HEADER_END.size();
+    }
+    return !records.empty();
+}
@@ -0,0 +1,68 @@
+//---------------------------------------------------------------------------
+// Header File for the response corpus: raw responses recorded during a crawl,
+// read back to replay them without the network.
+//---------------------------------------------------------------------------
+
+#ifndef CORPUS_H
+#define CORPUS_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <mutex>
+#include <cstdint>
+
+using namespace std;
+
+// A recorded response: the URL & the bytes received for it (status line, headers, body).
+typedef struct {
+    string_view uri;
+    string_view response;
+} CorpusRecord;
+
+// Append-only WARC-like file, one record per response:
+//   "WARC/1.0", WARC-Type, WARC-Target-URI, WARC-Date, Content-Type & Content-Length
+//   header lines, an empty line, the response as received, then "\r\n\r\n".
+// Its index <file>.idx has a line per record: "<uri> <offset of the response> <length>".
+// Responses of all the event loops go through one buffer, written in large blocks.
+class CorpusRecorder {
+    public:
+        static CorpusRecorder &instance();
+        string open(const string &path);
+        string close();
+        bool isOpen() const;
+        void record(string_view hostname, string_view path, string_view response);
+        uint64_t getRecords() const;
+    private:
+        CorpusRecorder();
+        ~CorpusRecorder();
+        string path;
+        int fd, indexFd;
+        mutex writeMutex;
+        string writeBuffer, indexBuffer;
+        uint64_t fileSize;                              // including the write buffer
+        uint64_t records;
+        string flushLocked();
+};
+
+// Read-only view of a corpus file, mapped at once. The records come from the
+// index, or from a scan of the record headers if there is none.
+class CorpusReader {
+    public:
+        CorpusReader();
+        ~CorpusReader();
+        string open(const string &path);
+        void close();
+        const vector<CorpusRecord> &getRecords() const;
+        uint64_t getBytes() const;
+    private:
+        const char *data;
+        size_t size;
+        vector<CorpusRecord> records;
+        string uris;                                    // the index, the URIs of the records point into it
+        uint64_t bytes;                                 // of the responses
+        bool readIndex(const string &indexPath);
+        bool scanRecords();
+};
+
+#endif
@@ -7,15 +7,32 @@
 //
 
 #include "clientSocket.h"
+#include "fetchEngine.h"
+#include "frontier.h"
+#include "shardedSet.h"
+#include "checkpoint.h"
+#include "dnsResolver.h"
+#include "bufferPool.h"
+#include "metrics.h"
+#include "pageCache.h"
+#include "resultWriter.h"
+#include "linkGraph.h"
+#include "corpus.h"
+#include "replay.h"
+#include "coordinator.h"
+#include "shardLink.h"
 #include "parser.h"
+#include "urlFilter.h"
 #include <iostream>
 #include <fstream>
 #include <queue>
 #include <vector>
-#include <thread>
+#include <algorithm>
 #include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <chrono>
 #include <map>
-#include <iomanip>
 #include <condition_variable>
 
 using namespace std;
@@ -23,43 +40,307 @@ using namespace std;
 // Config Struct with default settings.
 typedef struct {
 	int crawlDelay = 1000;
+	map<string, int> hostDelays;
+	int connectionsPerHost = 1;
+	map<string, int> hostConnections;
+	int hostBurst = 1;
+	bool adaptiveConcurrency = true;
+	int slowResponseTime = 1000;
 	int maxThreads = 10;
+	int maxConnections = 1000;
+	int pageTimeout = 30000;
+	int port = 80;
+	bool keepAlive = true;
+	int pipelineDepth = 1;
+	int dnsThreads = 4;
+	int dnsCacheTtl = 300;
+	int dnsNegativeTtl = 60;
+	string hostsFile = "";
+	int recvBufferSize = 65536;
+	string dedupMode = "exact";
+	double bloomFalsePositiveRate = 0.001;
+	int frontierMemoryLimit = 1000000;
+	string frontierDir = "frontier";
+	int checkpointInterval = 0;
+	string checkpointFile = "checkpoint.dat";
+	string metricsFile = "";
+	string metricsFormat = "prometheus";
+	int metricsInterval = 10;
+	int maxBodySize = 4194304;
+	bool compression = false;
+	int maxDecodedSize = 16777216;
+	string pageCacheFile = "";
+	string outputFormat = "text";
+	string outputFile = "";
+	int outputQueueSize = 4096;
+	string linkGraphFile = "";
+	string recordFile = "";
+	int replayPasses = 1;
 	int depthLimit = 10;
 	int pagesLimit = 10;
 	int linkedSitesLimit = 10;
+	vector< vector<string> > urlFilters;	// action, type, pattern
 	vector<string> startUrls;
 } Config;
 
 // CrawlerState for storing necessary info of the Crawler
 struct CrawlerState {
-	int threadsCount;
-	queue< pair<string, int> > pendingSites;
-	map<string, bool> discoveredSites;
+	Frontier *pendingSites;				// sites waiting, one queue per event loop
+	ShardedSet discoveredSites;			// every site ever added to pendingSites
+	atomic<int> unfinishedSites;		// sites waiting or being discovered
+	CrawlTotals totals;					// statistics of the finished sites
+	shared_mutex checkpointMutex;		// shared while a site is finishing, exclusive for a checkpoint
+	uint64_t outputBytes;				// output of the sites finished before the resumed checkpoint
 };
 
 // Variables
 Config config;
 CrawlerState crawlerState;
+mutex totalsMutex;
 mutex m_mutex;
 condition_variable m_condVar;
-bool threadFinished;
+bool crawlerFinished;
+FetchEngine *fetchEngine;
+ResultWriter *resultWriter;
+ShardLink *shardLink = NULL;			// set in a shard process of a --shards crawl
+string logPrefix = "";
+
+int crawl(bool resume);
+int replay(const string &corpusFile);
+bool setupUrlFilter();
+int coordinate(int numShards, bool resume);
+int runShard(int shard, int numShards, int fd);
+void receiveSites(vector<SiteTask> &tasks);
+void stopShard();
 
 Config readConfigFile();
-void initialize();
+void initialize(bool resume);
 void scheduleCrawlers();
-void startCrawler(string baseUrl, int currentDepth, CrawlerState &crawlerState);
+void finishCrawler(int worker, const SiteTask &task, SiteStats &stats);
+void printDnsStats();
+void printDedupStats();
+void saveCheckpoint();
+void dumpMetrics();
+void printCrawlTotals();
+void printPageCacheStats();
+void printFilterStats();
+void writeLinkGraph(LinkGraphBuilder &graph);
 
 int main(int argc, const char * argv[]) {		
+	bool resume = false;
+	int numShards = 1;
+	string corpusFile = "";
+	for (int i = 1; i < argc; i++) {
+		if (string(argv[i]) == "--resume") resume = true;
+		else if (string(argv[i]) == "--shards" && i + 1 < argc && atoi(argv[i + 1]) > 0) numShards = atoi(argv[++i]);
+		else if (string(argv[i]) == "--replay" && i + 1 < argc) corpusFile = argv[++i];
+		else {
+			cerr << "Usage: " << argv[0] << " [--resume] [--shards N] [--replay corpus]" << endl;
+			return 1;
+		}
+	}
 	config = readConfigFile();
-	initialize();
-	scheduleCrawlers();
-    return 0;
+	if (corpusFile != "") return replay(corpusFile);
+	if (numShards > 1) return coordinate(numShards, resume);
+	return crawl(resume);
 }
 
 //***************************************************************************
 // Functions' Implementation 
 //***************************************************************************
 
+//---------------------------------------------------------------------------
+// The crawl itself, of all the sites or of the sites of one shard.
+//---------------------------------------------------------------------------
+int crawl(bool resume) {
+	if (!setupUrlFilter()) return 1;
+	Frontier frontier(config.maxThreads, config.frontierMemoryLimit, config.frontierDir);
+	frontier.keepSpillFiles(config.checkpointInterval > 0);
+	crawlerState.pendingSites = &frontier;
+	DedupOptions siteDedup;
+	siteDedup.bloom = config.dedupMode == "bloom";
+	siteDedup.falsePositiveRate = config.bloomFalsePositiveRate;
+	siteDedup.initialCapacity = 4096;
+	crawlerState.discoveredSites.configure(siteDedup);
+	initialize(resume);
+	DnsResolver::instance().configure(config.dnsThreads, config.dnsCacheTtl, config.dnsNegativeTtl, config.hostsFile);
+	BufferPool::instance().configure(config.recvBufferSize, 16);
+	FetchOptions options;
+	options.pagesLimit = config.pagesLimit;
+	options.crawlDelay = config.crawlDelay;
+	options.hostDelays = config.hostDelays;
+	options.connectionsPerHost = config.connectionsPerHost;
+	options.hostConnections = config.hostConnections;
+	options.hostBurst = config.hostBurst;
+	options.adaptiveConcurrency = config.adaptiveConcurrency;
+	options.slowResponseTime = config.slowResponseTime;
+	options.pageTimeout = config.pageTimeout;
+	options.port = config.port;
+	options.keepAlive = config.keepAlive;
+	options.pipelineDepth = config.pipelineDepth;
+	options.maxBodySize = size_t(max(config.maxBodySize, 0));
+	options.compression = config.compression;
+	options.maxDecodedSize = size_t(max(config.maxDecodedSize, 0));
+	options.dedup.bloom = config.dedupMode == "bloom";
+	options.dedup.falsePositiveRate = config.bloomFalsePositiveRate;
+	options.linkGraph = config.linkGraphFile != "";
+	string error = config.pageCacheFile.empty() ? "" : PageCache::instance().open(config.pageCacheFile);
+	if (error.empty() && !config.recordFile.empty()) error = CorpusRecorder::instance().open(config.recordFile);
+	if (!error.empty()) {
+		cerr << "Error (@main): " << error << endl;
+		return 1;
+	}
+	LinkGraphBuilder graph;
+	ResultWriter writer(config.outputFormat, config.outputFile, config.outputQueueSize);
+	if (shardLink) writer.setSink([](const string &data) { shardLink->sendOutput(data); });
+	if (resume) writer.resumeAt(crawlerState.outputBytes);
+	if (options.linkGraph) writer.setLinkGraph(&graph);
+	error = writer.start();
+	if (!error.empty()) {
+		cerr << "Error (@main): " << error << endl;
+		return 1;
+	}
+	resultWriter = &writer;
+	FetchEngine engine(config.maxThreads, config.maxConnections, options, &frontier, finishCrawler);
+	fetchEngine = &engine;
+	scheduleCrawlers();
+	engine.stop();
+	error = writer.stop();
+	if (!error.empty()) cerr << "Error (@main): " << error << endl;
+	if (options.linkGraph) writeLinkGraph(graph);
+	if (shardLink) shardLink->finish(crawlerState.totals);
+	error = PageCache::instance().close();
+	if (!error.empty()) cerr << "Error (@main): " << error << endl;
+	error = CorpusRecorder::instance().close();
+	if (!error.empty()) cerr << "Error (@main): " << error << endl;
+	if (!config.recordFile.empty()) cerr << logPrefix << "Corpus: " << CorpusRecorder::instance().getRecords() << " responses recorded to " << config.recordFile << endl;
+	DnsResolver::instance().stop();
+	printDnsStats();
+	printDedupStats();
+	printFilterStats();
+	if (!shardLink) printCrawlTotals();
+	if (!config.pageCacheFile.empty()) printPageCacheStats();
+	return 0;
+}
+
+//---------------------------------------------------------------------------
+// Push a recorded corpus through the parse, filter & dedup stages on maxThreads
+// threads, as fast as they go, and report the speed of each stage.
+//---------------------------------------------------------------------------
+int replay(const string &corpusFile) {
+	if (!setupUrlFilter()) return 1;
+	CorpusReader corpus;
+	string error = corpus.open(corpusFile);
+	if (!error.empty()) {
+		cerr << "Error (@replay): " << error << endl;
+		return 1;
+	}
+	ReplayOptions options;
+	options.threads = config.maxThreads;
+	options.passes = config.replayPasses;
+	options.maxBodySize = size_t(max(config.maxBodySize, 0));
+	options.maxDecodedSize = size_t(max(config.maxDecodedSize, 0));
+	options.dedup.bloom = config.dedupMode == "bloom";
+	options.dedup.falsePositiveRate = config.bloomFalsePositiveRate;
+	ReplayStats stats = replayCorpus(corpus.getRecords(), options);
+
+	double megabytes = stats.bytes / 1e6;
+	cout << "Replay: " << corpus.getRecords().size() << " responses (" << corpus.getBytes() / 1e6 << " MB) x " << options.passes
+		<< " passes on " << options.threads << " threads in " << stats.seconds << "s" << endl;
+	cout << "Total: " << megabytes / stats.seconds << " MB/s, " << stats.responses / stats.seconds << " responses/s, "
+		<< stats.links / stats.seconds << " links/s" << endl;
+	cout << "Pages: " << stats.pages << ", links: " << stats.links << ", new pages: " << stats.newPages << ", new sites: " << stats.newSites << endl;
+	// Speed of one thread in each stage; input MB/s and items/s (pages, links out, links in)
+	for (int i = 0; i < NUM_REPLAY_STAGES; i++) {
+		StageStats &stage = stats.stages[i];
+		double seconds = stage.nanos / 1e9;
+		cout << "Stage " << REPLAY_STAGE_NAMES[i] << ": " << seconds << "s";
+		if (seconds > 0 && stage.bytes > 0) cout << ", " << stage.bytes / 1e6 / seconds << " MB/s";
+		if (seconds > 0) cout << ", " << stage.items / seconds << (i == STAGE_HTTP ? " pages/s" : " links/s");
+		cout << " per thread" << endl;
+	}
+	printFilterStats();
+	return 0;
+}
+
+//---------------------------------------------------------------------------
+// Rules of the URL filter from the config, compiled. False on a wrong rule.
+//---------------------------------------------------------------------------
+bool setupUrlFilter() {
+	for (auto &rule : config.urlFilters) {
+		string error = UrlFilter::instance().addRule(rule[0], rule[1], rule[2]);
+		if (!error.empty()) {
+			cerr << "Error (@setupUrlFilter): " << error << endl;
+			return false;
+		}
+	}
+	UrlFilter::instance().compile();
+	return true;
+}
+
+//---------------------------------------------------------------------------
+// Crawl with one process per shard of the hostnames; this process only routes
+// the sites between them & writes their output.
+//---------------------------------------------------------------------------
+int coordinate(int numShards, bool resume) {
+	if (resume) {
+		cerr << "Error (@coordinate): --resume doesn't work with --shards!" << endl;
+		return 1;
+	}
+	Coordinator coordinator(numShards);
+	string error = coordinator.start([numShards](int shard, int fd) { return runShard(shard, numShards, fd); });
+	if (error.empty()) error = coordinator.run(config.outputFormat, config.outputFile);
+	if (!error.empty()) cerr << "Error (@coordinate): " << error << endl;
+	crawlerState.totals = coordinator.getTotals();
+	printCrawlTotals();
+	return error.empty() ? 0 : 1;
+}
+
+//---------------------------------------------------------------------------
+// Forked shard process: a normal crawl of the sites it owns, with files of its own.
+//---------------------------------------------------------------------------
+int runShard(int shard, int numShards, int fd) {
+	ShardLink link(fd, shard, numShards);
+	shardLink = &link;
+	logPrefix = "Shard " + to_string(shard) + ": ";
+	string suffix = ".shard" + to_string(shard);
+	config.frontierDir += suffix;
+	if (config.pageCacheFile != "") config.pageCacheFile += suffix;
+	if (config.metricsFile != "") config.metricsFile += suffix;
+	if (config.linkGraphFile != "") config.linkGraphFile += suffix;
+	if (config.recordFile != "") config.recordFile += suffix;
+	if (config.checkpointInterval > 0) {
+		cerr << logPrefix << "checkpoints are off with --shards" << endl;
+		config.checkpointInterval = 0;
+	}
+	int result = crawl(false);
+	shardLink = NULL;
+	return result;
+}
+
+//---------------------------------------------------------------------------
+// Link thread of a shard: sites of this shard found by the others.
+//---------------------------------------------------------------------------
+void receiveSites(vector<SiteTask> &tasks) {
+	static int nextWorker = 0;
+	for (auto &task : tasks) {
+		if (crawlerState.discoveredSites.insert(task.hostname)) {
+			crawlerState.unfinishedSites++;
+			crawlerState.pendingSites->push(nextWorker++ % config.maxThreads, task);
+		}
+	}
+	fetchEngine->notifyWork();
+}
+
+//---------------------------------------------------------------------------
+// Link thread of a shard: every shard is idle, the crawl is over.
+//---------------------------------------------------------------------------
+void stopShard() {
+	lock_guard<mutex> m_lock(m_mutex);
+	crawlerFinished = true;
+	m_condVar.notify_one();
+}
+
 //---------------------------------------------------------------------------
 // Read and Process the config file. 
 //---------------------------------------------------------------------------
@@ -70,10 +351,58 @@ Config readConfigFile() {
 		Config cf;
 		while (cfFile >> var >> val) {
 			if (var == "crawlDelay") cf.crawlDelay = stoi(val);
+			else if (var == "hostDelay") {
+				string delay;
+				cfFile >> delay;
+				cf.hostDelays[val] = stoi(delay);
+			}
+			else if (var == "connectionsPerHost") cf.connectionsPerHost = stoi(val);
+			else if (var == "hostConnections") {
+				string connections;
+				cfFile >> connections;
+				cf.hostConnections[val] = stoi(connections);
+			}
+			else if (var == "hostBurst") cf.hostBurst = stoi(val);
+			else if (var == "adaptiveConcurrency") cf.adaptiveConcurrency = stoi(val) != 0;
+			else if (var == "slowResponseTime") cf.slowResponseTime = stoi(val);
 			else if (var == "maxThreads") cf.maxThreads = stoi(val);
+			else if (var == "maxConnections") cf.maxConnections = stoi(val);
+			else if (var == "pageTimeout") cf.pageTimeout = stoi(val);
+			else if (var == "port") cf.port = stoi(val);
+			else if (var == "keepAlive") cf.keepAlive = stoi(val) != 0;
+			else if (var == "pipelineDepth") cf.pipelineDepth = stoi(val);
+			else if (var == "dnsThreads") cf.dnsThreads = stoi(val);
+			else if (var == "dnsCacheTtl") cf.dnsCacheTtl = stoi(val);
+			else if (var == "dnsNegativeTtl") cf.dnsNegativeTtl = stoi(val);
+			else if (var == "hostsFile") cf.hostsFile = val;
+			else if (var == "recvBufferSize") cf.recvBufferSize = stoi(val);
+			else if (var == "dedupMode") cf.dedupMode = val;
+			else if (var == "bloomFalsePositiveRate") cf.bloomFalsePositiveRate = stod(val);
+			else if (var == "frontierMemoryLimit") cf.frontierMemoryLimit = stoi(val);
+			else if (var == "frontierDir") cf.frontierDir = val;
+			else if (var == "checkpointInterval") cf.checkpointInterval = stoi(val);
+			else if (var == "checkpointFile") cf.checkpointFile = val;
+			else if (var == "metricsFile") cf.metricsFile = val;
+			else if (var == "metricsFormat") cf.metricsFormat = val;
+			else if (var == "metricsInterval") cf.metricsInterval = stoi(val);
+			else if (var == "maxBodySize") cf.maxBodySize = stoi(val);
+			else if (var == "compression") cf.compression = stoi(val) != 0;
+			else if (var == "maxDecodedSize") cf.maxDecodedSize = stoi(val);
+			else if (var == "pageCacheFile") cf.pageCacheFile = val;
+			else if (var == "outputFormat") cf.outputFormat = val;
+			else if (var == "outputFile") cf.outputFile = val;
+			else if (var == "outputQueueSize") cf.outputQueueSize = stoi(val);
+			else if (var == "linkGraphFile") cf.linkGraphFile = val;
+			else if (var == "recordFile") cf.recordFile = val;
+			else if (var == "replayPasses") cf.replayPasses = stoi(val);
 			else if (var == "depthLimit") cf.depthLimit = stoi(val);
 			else if (var == "pagesLimit") cf.pagesLimit = stoi(val);
 			else if (var == "linkedSitesLimit") cf.linkedSitesLimit = stoi(val);
+			else if (var == "urlFilter") {
+				string type, pattern;
+				cfFile >> type >> pattern;
+				cf.urlFilters.push_back({val, type, pattern});
+			}
 			else if (var == "startUrls") {
 				for (int i = 0; i < stoi(val); i++) {
 					cfFile >> url;
@@ -90,91 +419,247 @@ Config readConfigFile() {
 }
 
 //---------------------------------------------------------------------------
-// Initialize the Crawler. 
+// Initialize the Crawler, from the starting urls or from the last checkpoint.
 //---------------------------------------------------------------------------
-void initialize() {
-	// Set threads count to 0
-	crawlerState.threadsCount = 0; 
-	// Add starting urls
+void initialize(bool resume) {
+	crawlerState.unfinishedSites = 0;
+	crawlerFinished = false;
+	if (resume) {
+		CheckpointData data;
+		string error = readCheckpoint(config.checkpointFile, data);
+		if (error.empty() && !crawlerState.pendingSites->restore(data.frontier)) error = "Cannot restore the frontier from " + config.frontierDir + "!";
+		if (error.empty() && !crawlerState.discoveredSites.load(data.discoveredSites)) error = "Cannot restore the discovered sites!";
+		if (!error.empty()) {
+			cerr << "Error (@initialize): " << error << endl;
+			exit(1);
+		}
+		crawlerState.totals = data.totals;
+		crawlerState.outputBytes = data.outputBytes;
+		crawlerState.unfinishedSites = int(crawlerState.pendingSites->size());
+		return;
+	}
+	// Add starting urls, spread over the event loops
+	int worker = 0;
 	for (auto url : config.startUrls) {
-		crawlerState.pendingSites.push(make_pair(getHostnameFromUrl(url), 0));
-		crawlerState.discoveredSites[getHostnameFromUrl(url)] = true;
+		string hostname(getHostnameFromUrl(url));
+		if (shardLink && !shardLink->owns(hostname)) continue;
+		if (crawlerState.discoveredSites.insert(hostname)) {
+			crawlerState.unfinishedSites++;
+			crawlerState.pendingSites->push(worker++, SiteTask{hostname, 0});
+		}
 	}
 }
 
 //---------------------------------------------------------------------------
-// Schedule crawlers in multithreads. Each thread discovers a specific host.
+// Start the crawlers on the fetch engine & wait until no site is left. Each event
+// loop discovers up to its share of maxConnections sites at once, taking them
+// from its own frontier queue or stealing from the others.
 //---------------------------------------------------------------------------
 void scheduleCrawlers() {
-	while (crawlerState.threadsCount != 0 || !crawlerState.pendingSites.empty()) {
-		m_mutex.lock();
-		threadFinished = false;
-		while (!crawlerState.pendingSites.empty() && crawlerState.threadsCount < config.maxThreads) {
-			// getting the next url to fetch
-			auto nextSite = crawlerState.pendingSites.front();
-			crawlerState.pendingSites.pop();
-			crawlerState.threadsCount++;
-
-			// start a new thread for crawling
-			thread t = thread(startCrawler, nextSite.first, nextSite.second, ref(crawlerState));
-			if (t.joinable()) t.detach();
-			// if (t.joinable()) t.join();
+	// A shard gets sites from the others until the coordinator stops it
+	if (crawlerState.unfinishedSites == 0 && !shardLink) return;
+	fetchEngine->start();
+	if (shardLink) shardLink->start(receiveSites, [] { return uint64_t(crawlerState.unfinishedSites); }, stopShard);
+
+	// wait for the last crawler to be done, with a checkpoint every checkpointInterval
+	// seconds & a metrics dump every metricsInterval seconds
+	bool checkpoints = config.checkpointInterval > 0, metrics = config.metricsFile != "" && config.metricsInterval > 0;
+	chrono::steady_clock::time_point now = chrono::steady_clock::now();
+	chrono::steady_clock::time_point nextCheckpoint = now + chrono::seconds(config.checkpointInterval);
+	chrono::steady_clock::time_point nextMetrics = now + chrono::seconds(config.metricsInterval);
+	unique_lock<mutex> m_lock(m_mutex);
+	while (!crawlerFinished) {
+		if (!checkpoints && !metrics) {
+			m_condVar.wait(m_lock);
+			continue;
+		}
+		chrono::steady_clock::time_point wakeUp = !checkpoints ? nextMetrics : !metrics ? nextCheckpoint : min(nextCheckpoint, nextMetrics);
+		if (m_condVar.wait_until(m_lock, wakeUp) != cv_status::timeout || crawlerFinished) continue;
+		m_lock.unlock();
+		now = chrono::steady_clock::now();
+		if (checkpoints && now >= nextCheckpoint) {
+			saveCheckpoint();
+			nextCheckpoint = chrono::steady_clock::now() + chrono::seconds(config.checkpointInterval);
 		}
-		m_mutex.unlock();
-
-		// wait for some thread is done, then request a lock & try to schedule again
-		unique_lock<mutex> m_lock(m_mutex);
-		while (!threadFinished) m_condVar.wait(m_lock);
-	}
-}
-
-//---------------------------------------------------------------------------
-// Start a crawler to discover a specific website.
-//---------------------------------------------------------------------------
-void startCrawler(string hostname, int currentDepth, CrawlerState &crawlerState) {
-	// Create socket, discover this website
-	ClientSocket clientSocket = ClientSocket(hostname, 80, config.pagesLimit, config.crawlDelay);
-	SiteStats stats = clientSocket.startDiscovering();
-
-	// Finish discovering, Exiting a crawler thread, output all statistics of the website.
-	m_mutex.lock();
-	cout << "----------------------------------------------------------------------------" << endl; 
-	cout << "Website: " << stats.hostname << endl;
-	cout << "Depth (distance from the starting pages): " << currentDepth << endl;
-	cout << "Number of Pages Discovered: " << stats.discoveredPages.size() << endl;
-	cout << "Number of Pages Failed to Discover: " << stats.numberOfPagesFailed << endl;
-	cout << "Number of Linked Sites: " << stats.linkedSites.size() << endl;
-	if (stats.minResponseTime < 0) cout << "Min. Response Time: N.A" << endl;
-		else cout << "Min. Response Time: " << stats.minResponseTime << "ms" << endl;
-	if (stats.maxResponseTime < 0) cout << "Max. Response Time: N.A" << endl;
-		else cout << "Max. Response Time: " << stats.maxResponseTime << "ms" << endl;
-	if (stats.averageResponseTime < 0) cout << "Average Response Time: N.A" << endl;
-		else cout << "Average Response Time: " << stats.averageResponseTime << "ms" << endl;
-	if (!stats.discoveredPages.empty()) {
-		cout << "List of visited pages:" << endl;
-		cout << "    " << setw(15) << "Response Time" << "    " << "URL" << endl;
-		for (auto page : stats.discoveredPages) {
-			cout << "    " << setw(13) << page.second << "ms" << "    " << page.first << endl;
+		if (metrics && now >= nextMetrics) {
+			dumpMetrics();
+			nextMetrics = chrono::steady_clock::now() + chrono::seconds(config.metricsInterval);
 		}
+		m_lock.lock();
 	}
+	m_lock.unlock();
+	if (checkpoints) saveCheckpoint();
+	if (config.metricsFile != "") dumpMetrics();
+}
+
+//---------------------------------------------------------------------------
+// Called from an event loop thread when a crawler is done with its website.
+//---------------------------------------------------------------------------
+void finishCrawler(int worker, const SiteTask &task, SiteStats &stats) {
+	int currentDepth = task.depth;
+	// Output, new sites & completion all land in the same checkpoint.
+	shared_lock<shared_mutex> checkpointLock(crawlerState.checkpointMutex);
+
+	totalsMutex.lock();
+	CrawlTotals &totals = crawlerState.totals;
+	totals.sites++;
+	totals.pages += stats.discoveredPages.size();
+	totals.pagesFailed += stats.numberOfPagesFailed;
+	totals.linkedSites += stats.linkedSites.size();
+	for (auto page : stats.discoveredPages) totals.totalResponseTime += page.second;
+	if (stats.minResponseTime >= 0 && (totals.minResponseTime < 0 || stats.minResponseTime < totals.minResponseTime)) totals.minResponseTime = stats.minResponseTime;
+	if (stats.maxResponseTime > totals.maxResponseTime) totals.maxResponseTime = stats.maxResponseTime;
+	totalsMutex.unlock();
+
+	// Every link counts for the priority of its site, even past linkedSitesLimit
+	Frontier *frontier = crawlerState.pendingSites;
+	for (auto site : stats.linkedSites) frontier->countLink(site);
 
 	// Only discover more if haven't reached the depthLimit
 	if (currentDepth < config.depthLimit) {
-		// Only discover more maximum of "linkedSitesLimit" websites.
-		for (int i = 0; i < min(int(stats.linkedSites.size()), config.linkedSitesLimit); i++) {
-			string site = stats.linkedSites[i];
-			if (!crawlerState.discoveredSites[site]) {
-				crawlerState.pendingSites.push(make_pair(site, currentDepth+1));
-				crawlerState.discoveredSites[site] = true;
+		// Only discover more maximum of "linkedSitesLimit" websites, the most linked to first.
+		vector< pair<uint32_t, int> > ranked;
+		for (int i = 0; i < int(stats.linkedSites.size()); i++) ranked.push_back(make_pair(frontier->linkCount(stats.linkedSites[i]), i));
+		stable_sort(ranked.begin(), ranked.end(), [](const pair<uint32_t, int> &a, const pair<uint32_t, int> &b) { return a.first > b.first; });
+		int added = 0;
+		for (int i = 0; i < int(ranked.size()) && added < config.linkedSitesLimit; i++) {
+			string site(stats.linkedSites[ranked[i].second]);
+			if (!crawlerState.discoveredSites.insert(site)) continue;
+			added++;
+			// A site of another shard is sent to it, once
+			if (shardLink && !shardLink->owns(site)) {
+				shardLink->forward(SiteTask{site, currentDepth+1});
+			} else {
+				crawlerState.unfinishedSites++;
+				crawlerState.pendingSites->push(worker, SiteTask{site, currentDepth+1});
 			}
 		}
 	}
-	crawlerState.threadsCount --;
-	threadFinished = true;
-	m_mutex.unlock();
-	
-	// Notify the master (original thread) about this ThreadFinished event.
-	m_condVar.notify_one();
+
+	// Output all statistics of the website, on the writer thread.
+	resultWriter->push(SiteResult{move(stats), currentDepth});
+	crawlerState.pendingSites->complete(worker, task.hostname);
+	checkpointLock.unlock();
+
+	// This site is done; the last one ends the crawl. Notify the master (original thread).
+	// A shard waits for the coordinator instead, other shards may still send sites.
+	if (--crawlerState.unfinishedSites == 0 && !shardLink) {
+		lock_guard<mutex> m_lock(m_mutex);
+		crawlerFinished = true;
+		m_condVar.notify_one();
+	}
+}
+
+//---------------------------------------------------------------------------
+// Summary of the shared DNS cache, on stderr to keep the site statistics clean.
+//---------------------------------------------------------------------------
+void printDnsStats() {
+	DnsStats dns = DnsResolver::instance().getStats();
+	cerr << logPrefix << "DNS cache: " << dns.hits << " hits, " << dns.negativeHits << " negative hits, "
+		<< dns.misses << " misses, " << dns.coalesced << " coalesced, " << dns.failures << " failures, "
+		<< dns.hostsFileHits << " hosts file hits" << endl;
+}
+
+//---------------------------------------------------------------------------
+// Memory per URL of the dedup sets & their lookup speed, on stderr.
+//---------------------------------------------------------------------------
+void printDedupStats() {
+	DedupStats dedup = UrlDedup::getStats();
+	size_t sites = crawlerState.discoveredSites.size(), siteBytes = crawlerState.discoveredSites.memoryBytes();
+	cerr << logPrefix << "Dedup (" << config.dedupMode << "): " << sites << " sites, "
+		<< (sites > 0 ? double(siteBytes) / sites : 0) << " bytes/site; "
+		<< dedup.retiredUrls << " pages & linked sites, "
+		<< (dedup.retiredUrls > 0 ? double(dedup.retiredBytes) / dedup.retiredUrls : 0) << " bytes/url; "
+		<< dedup.lookups << " lookups, "
+		<< (dedup.nanosPerLookup > 0 ? 1000.0 / dedup.nanosPerLookup : 0) << " M lookups/s" << endl;
+}
+
+//---------------------------------------------------------------------------
+// Save the frontier, the discovered sites & the totals. Sites finishing meanwhile
+// wait, so the three agree: a site is either finished or still in the frontier.
+//---------------------------------------------------------------------------
+void saveCheckpoint() {
+	CheckpointData data;
+	string error;
+	{
+		unique_lock<shared_mutex> checkpointLock(crawlerState.checkpointMutex);
+		error = crawlerState.pendingSites->snapshot(data.frontier);
+		crawlerState.discoveredSites.save(data.discoveredSites);
+		data.totals = crawlerState.totals;
+		// The output must hold every site the checkpoint counts as finished
+		resultWriter->flush();
+		data.outputBytes = resultWriter->getOutputBytes();
+	}
+	// Outside the lock: sites finished meanwhile only add bytes after data.outputBytes
+	if (error.empty()) error = resultWriter->sync();
+	if (error.empty()) error = writeCheckpoint(config.checkpointFile, data);
+	if (!error.empty()) cerr << "Error (@saveCheckpoint): " << error << endl;
+		else crawlerState.pendingSites->checkpointWritten();
+}
+
+//---------------------------------------------------------------------------
+// Statistics of the whole crawl, resumed parts included, on stderr.
+//---------------------------------------------------------------------------
+void printCrawlTotals() {
+	CrawlTotals &totals = crawlerState.totals;
+	cerr << "Crawl: " << totals.sites << " websites, " << totals.pages << " pages, "
+		<< totals.pagesFailed << " pages failed, " << totals.linkedSites << " linked sites";
+	if (totals.pages > 0) {
+		cerr << ", response time min " << totals.minResponseTime << "ms / avg "
+			<< totals.totalResponseTime / totals.pages << "ms / max " << totals.maxResponseTime << "ms";
+	}
+	cerr << endl;
+}
+
+//---------------------------------------------------------------------------
+// How much of the previous crawl was reused, on stderr.
+//---------------------------------------------------------------------------
+void printPageCacheStats() {
+	PageCacheStats cache = PageCache::instance().getStats();
+	cerr << logPrefix << "Page cache: " << cache.loadedPages << " pages loaded, " << cache.hits << " hits, "
+		<< cache.notModified << " not modified, " << cache.unchanged << " unchanged, "
+		<< cache.stored << " stored" << endl;
+}
+
+//---------------------------------------------------------------------------
+// Links checked by the URL filter & the hits of each rule, on stderr.
+//---------------------------------------------------------------------------
+void printFilterStats() {
+	FilterStats filter = UrlFilter::instance().getStats();
+	cerr << logPrefix << "URL filter: " << filter.checked << " links checked, " << filter.rejected << " rejected;";
+	for (auto &rule : filter.rules) cerr << " " << rule.rule << " (" << rule.hits << ")";
+	cerr << endl;
 }
 
+//---------------------------------------------------------------------------
+// Write the link graph of the finished sites to linkGraphFile.
+//---------------------------------------------------------------------------
+void writeLinkGraph(LinkGraphBuilder &graph) {
+	string error = graph.write(config.linkGraphFile);
+	if (!error.empty()) {
+		cerr << "Error (@writeLinkGraph): " << error << endl;
+		return;
+	}
+	cerr << logPrefix << "Link graph: " << graph.getHosts() << " hosts, " << graph.getPages() << " pages written to " << config.linkGraphFile << endl;
+}
 
+//---------------------------------------------------------------------------
+// Write the fetch metrics, the frontier & buffer pool gauges to metricsFile.
+//---------------------------------------------------------------------------
+void dumpMetrics() {
+	Frontier *frontier = crawlerState.pendingSites;
+	double waiting = double(frontier->size());
+	vector<Gauge> gauges;
+	gauges.push_back(Gauge{"frontier_sites", "Sites waiting in the frontier, in memory and on disk.", waiting});
+	gauges.push_back(Gauge{"frontier_spilled_sites", "Sites waiting in the frontier files on disk.", double(frontier->spilledSize())});
+	gauges.push_back(Gauge{"sites_in_progress", "Sites being discovered.", max(double(crawlerState.unfinishedSites) - waiting, 0.0)});
+	gauges.push_back(Gauge{"sites_discovered", "Sites ever added to the frontier.", double(crawlerState.discoveredSites.size())});
+	totalsMutex.lock();
+	gauges.push_back(Gauge{"sites_finished", "Sites done, resumed crawls included.", double(crawlerState.totals.sites)});
+	totalsMutex.unlock();
+	BufferPoolStats buffers = BufferPool::instance().getStats();
+	gauges.push_back(Gauge{"recv_buffers_allocated", "Receive buffers created by the pool.", double(buffers.allocated)});
+	gauges.push_back(Gauge{"recv_buffers_reused", "Receive buffers handed out again from a free list.", double(buffers.reused)});
+	string error = Metrics::instance().dump(config.metricsFile, config.metricsFormat, gauges);
+	if (!error.empty()) cerr << "Error (@dumpMetrics): " << error << endl;
+}
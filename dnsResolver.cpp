@@ -0,0 +1,188 @@
+//---------------------------------------------------------------------------
+// C++ Implementation file for the DNS resolver, a process-wide cache shared by all the sockets.
+// Lookups run getaddrinfo on a few resolver threads so the event loops never block;
+// concurrent lookups of the same hostname share one resolution.
+//---------------------------------------------------------------------------
+
+#include "dnsResolver.h"
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+using namespace std::chrono;
+
+// Expired entries are purged once the cache grows past this size.
+static const size_t CACHE_PURGE_SIZE = 1 << 20;
+
+//---------------------------------------------------------------------------
+// The process-wide resolver.
+//---------------------------------------------------------------------------
+DnsResolver &DnsResolver::instance() {
+    static DnsResolver resolver;
+    return resolver;
+}
+
+DnsResolver::DnsResolver() {
+    this->stopping = false;
+    this->positiveTtl = 300;
+    this->negativeTtl = 60;
+    hits = negativeHits = misses = coalesced = failures = hostsFileHits = 0;
+}
+
+DnsResolver::~DnsResolver() {
+    stop();
+}
+
+//---------------------------------------------------------------------------
+// Start the resolver threads. TTLs are in seconds; hostsFile ("" for none) has
+// the /etc/hosts syntax and takes precedence over the system resolver.
+//---------------------------------------------------------------------------
+void DnsResolver::configure(int numThreads, int positiveTtl, int negativeTtl, string hostsFile) {
+    lock_guard<mutex> lock(m_mutex);
+    this->positiveTtl = positiveTtl;
+    this->negativeTtl = negativeTtl;
+    if (hostsFile != "") loadHostsFile(hostsFile);
+    for (int i = int(workers.size()); i < max(numThreads, 1); i++) {
+        workers.push_back(thread(&DnsResolver::runWorker, this));
+    }
+}
+
+//---------------------------------------------------------------------------
+// Answer from the hosts file or the cache. Return false if a resolution is needed.
+//---------------------------------------------------------------------------
+bool DnsResolver::lookup(const string &hostname, bool &found, struct in_addr &address) {
+    lock_guard<mutex> lock(m_mutex);
+    return lookupLocked(hostname, found, address);
+}
+
+bool DnsResolver::lookupLocked(const string &hostname, bool &found, struct in_addr &address) {
+    auto host = hostsEntries.find(hostname);
+    if (host != hostsEntries.end()) {
+        hostsFileHits++;
+        found = true;
+        address = host->second;
+        return true;
+    }
+
+    auto entry = cache.find(hostname);
+    if (entry == cache.end()) return false;
+    if (entry->second.expires <= steady_clock::now()) {
+        cache.erase(entry);
+        return false;
+    }
+    found = entry->second.found;
+    address = entry->second.address;
+    if (found) hits++;
+        else negativeHits++;
+    return true;
+}
+
+//---------------------------------------------------------------------------
+// Resolve a hostname. onResolved is called right away on a cache hit, or later
+// from a resolver thread.
+//---------------------------------------------------------------------------
+void DnsResolver::resolve(const string &hostname, function<void(bool, struct in_addr)> onResolved) {
+    bool found = false;
+    struct in_addr address = {};
+    {
+        lock_guard<mutex> lock(m_mutex);
+        if (!lookupLocked(hostname, found, address)) {
+            auto lookup = inFlight.find(hostname);
+            if (lookup != inFlight.end()) {
+                coalesced++;
+                lookup->second.push_back(onResolved);
+            } else {
+                misses++;
+                inFlight[hostname].push_back(onResolved);
+                pendingLookups.push_back(hostname);
+                m_condVar.notify_one();
+            }
+            return;
+        }
+    }
+    onResolved(found, address);
+}
+
+DnsStats DnsResolver::getStats() {
+    DnsStats stats;
+    stats.hits = hits;
+    stats.negativeHits = negativeHits;
+    stats.misses = misses;
+    stats.coalesced = coalesced;
+    stats.failures = failures;
+    stats.hostsFileHits = hostsFileHits;
+    return stats;
+}
+
+//---------------------------------------------------------------------------
+// Stop the resolver threads. Lookups still queued are dropped.
+//---------------------------------------------------------------------------
+void DnsResolver::stop() {
+    {
+        lock_guard<mutex> lock(m_mutex);
+        stopping = true;
+    }
+    m_condVar.notify_all();
+    for (auto &t : workers) if (t.joinable()) t.join();
+    workers.clear();
+}
+
+//---------------------------------------------------------------------------
+// Read "address name [name...]" lines, '#' starts a comment.
+//---------------------------------------------------------------------------
+void DnsResolver::loadHostsFile(string hostsFile) {
+    ifstream file(hostsFile);
+    string line, ip, name;
+    while (getline(file, line)) {
+        line = line.substr(0, line.find('#'));
+        istringstream fields(line);
+        struct in_addr address;
+        if (!(fields >> ip) || inet_pton(AF_INET, ip.c_str(), &address) != 1) continue;
+        while (fields >> name) hostsEntries[name] = address;
+    }
+}
+
+//---------------------------------------------------------------------------
+// Resolver thread: take a hostname, resolve it, cache the answer, call back everyone waiting.
+//---------------------------------------------------------------------------
+void DnsResolver::runWorker() {
+    while (true) {
+        string hostname;
+        {
+            unique_lock<mutex> lock(m_mutex);
+            while (!stopping && pendingLookups.empty()) m_condVar.wait(lock);
+            if (stopping) return;
+            hostname = pendingLookups.front();
+            pendingLookups.pop_front();
+        }
+
+        struct addrinfo hints = {}, *result = NULL;
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        CacheEntry entry;
+        entry.found = getaddrinfo(hostname.c_str(), NULL, &hints, &result) == 0 && result != NULL;
+        entry.address = entry.found ? ((struct sockaddr_in *)result->ai_addr)->sin_addr : in_addr();
+        entry.expires = steady_clock::now() + seconds(entry.found ? positiveTtl : negativeTtl);
+        if (result != NULL) freeaddrinfo(result);
+        if (!entry.found) failures++;
+
+        vector< function<void(bool, struct in_addr)> > callbacks;
+        {
+            lock_guard<mutex> lock(m_mutex);
+            if (cache.size() >= CACHE_PURGE_SIZE) {
+                steady_clock::time_point now = steady_clock::now();
+                for (auto it = cache.begin(); it != cache.end(); ) {
+                    if (it->second.expires <= now) it = cache.erase(it);
+                        else ++it;
+                }
+            }
+            cache[hostname] = entry;
+            callbacks.swap(inFlight[hostname]);
+            inFlight.erase(hostname);
+        }
+        for (auto &callback : callbacks) callback(entry.found, entry.address);
+    }
+}
@@ -0,0 +1,65 @@
+//---------------------------------------------------------------------------
+// Header File for the DNS resolver, a process-wide cache shared by all the sockets.
+//---------------------------------------------------------------------------
+
+#ifndef DNSRESOLVER_H
+#define DNSRESOLVER_H
+
+#include <netinet/in.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <unordered_map>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+using namespace std;
+
+typedef struct {
+    uint64_t hits = 0;                                  // answered from the cache
+    uint64_t negativeHits = 0;                          // answered "not found" from the cache
+    uint64_t misses = 0;                                // sent to the system resolver
+    uint64_t coalesced = 0;                             // joined a lookup already in flight
+    uint64_t failures = 0;                              // system resolver found nothing
+    uint64_t hostsFileHits = 0;                         // answered by the hosts file
+} DnsStats;
+
+class DnsResolver {
+    public:
+        static DnsResolver &instance();
+        void configure(int numThreads, int positiveTtl, int negativeTtl, string hostsFile);
+        bool lookup(const string &hostname, bool &found, struct in_addr &address);
+        void resolve(const string &hostname, function<void(bool, struct in_addr)> onResolved);
+        DnsStats getStats();
+        void stop();
+    private:
+        typedef struct {
+            bool found;
+            struct in_addr address;
+            chrono::steady_clock::time_point expires;
+        } CacheEntry;
+
+        DnsResolver();
+        ~DnsResolver();
+        mutex m_mutex;
+        condition_variable m_condVar;
+        unordered_map<string, CacheEntry> cache;
+        unordered_map<string, vector< function<void(bool, struct in_addr)> > > inFlight;
+        map<string, struct in_addr> hostsEntries;
+        deque<string> pendingLookups;
+        vector<thread> workers;
+        bool stopping;
+        int positiveTtl, negativeTtl;
+        atomic<uint64_t> hits, negativeHits, misses, coalesced, failures, hostsFileHits;
+        bool lookupLocked(const string &hostname, bool &found, struct in_addr &address);
+        void loadHostsFile(string hostsFile);
+        void runWorker();
+};
+
+#endif
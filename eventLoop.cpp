@@ -0,0 +1,147 @@
+//---------------------------------------------------------------------------
+// C++ Implementation file for the event loop, an epoll based reactor driving non-blocking sockets.
+//---------------------------------------------------------------------------
+
+#include "eventLoop.h"
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <cerrno>
+#include <stdexcept>
+
+using namespace std;
+using namespace std::chrono;
+
+//---------------------------------------------------------------------------
+// EventLoop constructor. The eventfd is used to wake up epoll_wait when a task is posted.
+//---------------------------------------------------------------------------
+EventLoop::EventLoop() {
+    this->epollFd = epoll_create1(EPOLL_CLOEXEC);
+    this->wakeupFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epollFd == -1 || wakeupFd == -1) throw runtime_error("Cannot create event loop!");
+    this->running = true;
+    this->nextTimerId = 1;
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeupFd, &ev);
+}
+
+EventLoop::~EventLoop() {
+    close(wakeupFd);
+    close(epollFd);
+}
+
+//---------------------------------------------------------------------------
+// Run the loop in the calling thread until stop() is called.
+//---------------------------------------------------------------------------
+void EventLoop::run() {
+    struct epoll_event events[128];
+    while (running) {
+        int n = epoll_wait(epollFd, events, 128, nextTimeout());
+        if (n < 0 && errno != EINTR) break;
+        for (int i = 0; i < n; i++) {
+            EventHandler *handler = (EventHandler *)events[i].data.ptr;
+            if (handler == NULL) {
+                // Wake up event, drain the counter.
+                uint64_t counter;
+                while (read(wakeupFd, &counter, sizeof(counter)) > 0);
+            } else {
+                handler->handleEvent(events[i].events);
+            }
+        }
+        runTimers();
+        runPendingTasks();
+    }
+}
+
+//---------------------------------------------------------------------------
+// Stop the loop. Safe to call from any thread.
+//---------------------------------------------------------------------------
+void EventLoop::stop() {
+    running = false;
+    uint64_t one = 1;
+    if (write(wakeupFd, &one, sizeof(one)) < 0) {}
+}
+
+//---------------------------------------------------------------------------
+// Queue a task to be run by the loop thread. Safe to call from any thread.
+//---------------------------------------------------------------------------
+void EventLoop::post(function<void()> task) {
+    {
+        lock_guard<mutex> lock(tasksMutex);
+        pendingTasks.push_back(task);
+    }
+    uint64_t one = 1;
+    if (write(wakeupFd, &one, sizeof(one)) < 0) {}
+}
+
+//---------------------------------------------------------------------------
+// Register, update and remove a file descriptor. Only called by the loop thread.
+//---------------------------------------------------------------------------
+bool EventLoop::addFd(int fd, uint32_t events, EventHandler *handler) {
+    struct epoll_event ev;
+    ev.events = events;
+    ev.data.ptr = handler;
+    return epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) == 0;
+}
+
+bool EventLoop::modifyFd(int fd, uint32_t events, EventHandler *handler) {
+    struct epoll_event ev;
+    ev.events = events;
+    ev.data.ptr = handler;
+    return epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &ev) == 0;
+}
+
+void EventLoop::removeFd(int fd) {
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+//---------------------------------------------------------------------------
+// Schedule a task after the given delay. Return the timer id for cancelTimer().
+// Only called by the loop thread.
+//---------------------------------------------------------------------------
+uint64_t EventLoop::runAfter(microseconds delay, function<void()> task) {
+    uint64_t timerId = nextTimerId++;
+    TimePoint deadline = steady_clock::now() + delay;
+    timers[make_pair(deadline, timerId)] = task;
+    timerDeadlines[timerId] = deadline;
+    return timerId;
+}
+
+void EventLoop::cancelTimer(uint64_t timerId) {
+    auto it = timerDeadlines.find(timerId);
+    if (it == timerDeadlines.end()) return;
+    timers.erase(make_pair(it->second, timerId));
+    timerDeadlines.erase(it);
+}
+
+//---------------------------------------------------------------------------
+// Milliseconds until the earliest timer, to be used as the epoll_wait timeout.
+//---------------------------------------------------------------------------
+int EventLoop::nextTimeout() {
+    if (timers.empty()) return -1;
+    auto wait = duration_cast<milliseconds>(timers.begin()->first.first - steady_clock::now()).count();
+    if (wait < 0) return 0;
+    return int(wait) + 1;
+}
+
+void EventLoop::runTimers() {
+    TimePoint now = steady_clock::now();
+    while (!timers.empty() && timers.begin()->first.first <= now) {
+        function<void()> task = timers.begin()->second;
+        timerDeadlines.erase(timers.begin()->first.second);
+        timers.erase(timers.begin());
+        task();
+    }
+}
+
+void EventLoop::runPendingTasks() {
+    vector< function<void()> > tasks;
+    {
+        lock_guard<mutex> lock(tasksMutex);
+        tasks.swap(pendingTasks);
+    }
+    for (auto &task : tasks) task();
+}
@@ -0,0 +1,51 @@
+//---------------------------------------------------------------------------
+// Header File for the event loop, an epoll based reactor driving non-blocking sockets.
+//---------------------------------------------------------------------------
+
+#ifndef EVENTLOOP_H
+#define EVENTLOOP_H
+
+#include <functional>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+using namespace std;
+
+// Anything registered on the loop with a file descriptor.
+class EventHandler {
+    public:
+        virtual ~EventHandler() {}
+        virtual void handleEvent(uint32_t events) = 0;
+};
+
+class EventLoop {
+    public:
+        EventLoop();
+        ~EventLoop();
+        void run();
+        void stop();
+        void post(function<void()> task);
+        bool addFd(int fd, uint32_t events, EventHandler *handler);
+        bool modifyFd(int fd, uint32_t events, EventHandler *handler);
+        void removeFd(int fd);
+        uint64_t runAfter(chrono::microseconds delay, function<void()> task);
+        void cancelTimer(uint64_t timerId);
+    private:
+        typedef chrono::steady_clock::time_point TimePoint;
+        int epollFd, wakeupFd;
+        atomic<bool> running;
+        mutex tasksMutex;
+        vector< function<void()> > pendingTasks;                // tasks posted from any thread
+        map< pair<TimePoint, uint64_t>, function<void()> > timers;  // timers, only touched by the loop thread
+        map<uint64_t, TimePoint> timerDeadlines;
+        uint64_t nextTimerId;
+        int nextTimeout();
+        void runTimers();
+        void runPendingTasks();
+};
+
+#endif
@@ -0,0 +1,91 @@
+//---------------------------------------------------------------------------
+// C++ Implementation file for the fetch engine, a fixed set of event loop threads that discover many hosts at once.
+//---------------------------------------------------------------------------
+
+#include "fetchEngine.h"
+
+using namespace std;
+
+//---------------------------------------------------------------------------
+// FetchEngine constructor. maxConnections is split evenly between the loops.
+//---------------------------------------------------------------------------
+FetchEngine::FetchEngine(int numLoops, int maxConnections, const FetchOptions &options, Frontier *frontier, FinishedCallback onFinished) {
+    this->options = options;
+    this->frontier = frontier;
+    this->onFinished = onFinished;
+    numLoops = max(numLoops, 1);
+    this->capacity = max((maxConnections + numLoops - 1) / numLoops, 1);
+    for (int i = 0; i < numLoops; i++) {
+        Worker *worker = new Worker();
+        worker->loop.reset(new EventLoop());
+        worker->scheduler.reset(new PolitenessScheduler(worker->loop.get(), this->options.crawlDelay, &this->options.hostDelays));
+        worker->active = 0;
+        worker->wakeupPending = false;
+        workers.push_back(unique_ptr<Worker>(worker));
+    }
+}
+
+FetchEngine::~FetchEngine() {
+    stop();
+}
+
+//---------------------------------------------------------------------------
+// Start one thread per event loop, each begins with its own frontier queue.
+//---------------------------------------------------------------------------
+void FetchEngine::start() {
+    for (int i = 0; i < int(workers.size()); i++) {
+        EventLoop *loop = workers[i]->loop.get();
+        loop->post([this, i] { fillWorker(i); });
+        threads.push_back(thread([loop] { loop->run(); }));
+    }
+}
+
+//---------------------------------------------------------------------------
+// Stop all the event loops and wait for their threads.
+//---------------------------------------------------------------------------
+void FetchEngine::stop() {
+    for (auto &worker : workers) worker->loop->stop();
+    for (auto &t : threads) if (t.joinable()) t.join();
+    threads.clear();
+}
+
+//---------------------------------------------------------------------------
+// New sites are in the frontier: wake up the loops that have free slots. Safe from any thread.
+//---------------------------------------------------------------------------
+void FetchEngine::notifyWork() {
+    for (int i = 0; i < int(workers.size()) && frontier->size() > 0; i++) {
+        Worker &worker = *workers[i];
+        if (worker.active < capacity && !worker.wakeupPending.exchange(true)) {
+            worker.loop->post([this, i] { fillWorker(i); });
+        }
+    }
+}
+
+//---------------------------------------------------------------------------
+// Loop thread: start sites until this loop is full or the frontier is empty.
+//---------------------------------------------------------------------------
+void FetchEngine::fillWorker(int worker) {
+    workers[worker]->wakeupPending = false;
+    SiteTask task;
+    while (workers[worker]->active < capacity && frontier->pop(worker, task)) {
+        workers[worker]->active++;
+        startSite(worker, task);
+    }
+}
+
+//---------------------------------------------------------------------------
+// Discover a site on the worker's loop. The socket is freed once it reported its stats.
+//---------------------------------------------------------------------------
+void FetchEngine::startSite(int worker, const SiteTask &task) {
+    EventLoop *loop = workers[worker]->loop.get();
+    ClientSocket *clientSocket = new ClientSocket(loop, workers[worker]->scheduler.get(), task.hostname, options);
+    clientSocket->startDiscovering([this, worker, task, loop, clientSocket](SiteStats &stats) {
+        onFinished(worker, task, stats);
+        workers[worker]->active--;
+        loop->post([this, worker, clientSocket] {
+            delete clientSocket;
+            fillWorker(worker);
+        });
+        notifyWork();
+    });
+}
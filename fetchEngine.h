@@ -0,0 +1,49 @@
+//---------------------------------------------------------------------------
+// Header File for the fetch engine, a fixed set of event loop threads that discover many hosts at once.
+//---------------------------------------------------------------------------
+
+#ifndef FETCHENGINE_H
+#define FETCHENGINE_H
+
+#include "clientSocket.h"
+#include "eventLoop.h"
+#include "frontier.h"
+#include <string>
+#include <vector>
+#include <thread>
+#include <memory>
+#include <atomic>
+#include <functional>
+
+using namespace std;
+
+// Each event loop is a worker: it takes sites from its frontier queue (or steals)
+// while it has less than its share of maxConnections sites in progress.
+class FetchEngine {
+    public:
+        typedef function<void(int worker, const SiteTask &task, SiteStats &stats)> FinishedCallback;
+
+        FetchEngine(int numLoops, int maxConnections, const FetchOptions &options, Frontier *frontier, FinishedCallback onFinished);
+        ~FetchEngine();
+        void start();
+        void stop();
+        void notifyWork();
+    private:
+        typedef struct {
+            unique_ptr<EventLoop> loop;
+            unique_ptr<PolitenessScheduler> scheduler;
+            atomic<int> active;                         // sites being discovered by this loop
+            atomic<bool> wakeupPending;                 // a fillWorker task is already posted
+        } Worker;
+
+        FetchOptions options;
+        Frontier *frontier;
+        FinishedCallback onFinished;
+        int capacity;
+        vector< unique_ptr<Worker> > workers;
+        vector<thread> threads;
+        void fillWorker(int worker);
+        void startSite(int worker, const SiteTask &task);
+};
+
+#endif
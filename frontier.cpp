@@ -0,0 +1,242 @@
+//---------------------------------------------------------------------------
+// C++ Implementation file for the frontier, the sites waiting to be discovered.
+//---------------------------------------------------------------------------
+
+#include "frontier.h"
+#include "spillStore.h"
+#include "urlDedup.h"
+#include <algorithm>
+
+using namespace std;
+
+// Sites read back from the spill files at once, per worker.
+static const size_t REFILL_BATCH = 4096;
+
+//---------------------------------------------------------------------------
+// Frontier constructor. A memoryLimit of 0 keeps every site in memory.
+//---------------------------------------------------------------------------
+Frontier::Frontier(int numWorkers, size_t memoryLimit, const string &spillDirectory) {
+    for (int i = 0; i < max(numWorkers, 1); i++) queues.push_back(unique_ptr<WorkerQueue>(new WorkerQueue()));
+    this->inLinks.reset(new atomic<uint32_t>[SKETCH_ROWS * SKETCH_WIDTH]);
+    for (size_t i = 0; i < SKETCH_ROWS * SKETCH_WIDTH; i++) inLinks[i] = 0;
+    this->nextOrder = 0;
+    this->count = 0;
+    this->spilled = 0;
+    this->removableSpillFiles = 0;
+    this->memoryLimit = memoryLimit;
+    if (memoryLimit > 0) spill.reset(new SpillStore(spillDirectory));
+}
+
+Frontier::~Frontier() {
+}
+
+//---------------------------------------------------------------------------
+// Add a site to the worker's own queue, or to disk when memory is full. Once
+// sites are on disk, new ones follow them so the order is kept.
+//---------------------------------------------------------------------------
+void Frontier::push(int worker, const SiteTask &task) {
+    shared_lock<shared_mutex> snapshotLock(snapshotMutex);
+    if (spill && (spilled > 0 || count >= memoryLimit)) {
+        lock_guard<mutex> lock(spillMutex);
+        spill->append(task);
+        spilled++;
+        return;
+    }
+    QueuedSite site = queued(task);
+    WorkerQueue &queue = *queues[worker % queues.size()];
+    lock_guard<mutex> lock(queue.m_mutex);
+    insert(queue, site);
+    count++;
+}
+
+//---------------------------------------------------------------------------
+// Take the best site of the worker's own queue, or steal one, or read from
+// disk. Return false if all are empty. The site stays in the frontier's
+// snapshots until complete() is called.
+//---------------------------------------------------------------------------
+bool Frontier::pop(int worker, SiteTask &task) {
+    shared_lock<shared_mutex> snapshotLock(snapshotMutex);
+    WorkerQueue &queue = *queues[worker % queues.size()];
+    {
+        lock_guard<mutex> lock(queue.m_mutex);
+        if (!queue.tasks.empty()) {
+            task = removeTop(queue);
+            queue.inProgress[task.hostname] = task.depth;
+            count--;
+            return true;
+        }
+    }
+    return steal(worker, task) || refill(worker, task);
+}
+
+//---------------------------------------------------------------------------
+// Take half of another worker's queue: the end of its heap array, leaves that
+// its owner would take last. What is left is still a heap.
+//---------------------------------------------------------------------------
+bool Frontier::steal(int thief, SiteTask &task) {
+    int n = int(queues.size());
+    vector<QueuedSite> stolen;
+    for (int i = 1; i < n && stolen.empty(); i++) {
+        WorkerQueue &victim = *queues[(thief + i) % n];
+        lock_guard<mutex> lock(victim.m_mutex);
+        size_t half = (victim.tasks.size() + 1) / 2;
+        stolen.assign(victim.tasks.end() - half, victim.tasks.end());
+        victim.tasks.resize(victim.tasks.size() - half);
+    }
+    if (stolen.empty()) return false;
+
+    count--;
+    WorkerQueue &queue = *queues[thief % n];
+    lock_guard<mutex> lock(queue.m_mutex);
+    for (auto &site : stolen) insert(queue, site);
+    task = removeTop(queue);
+    queue.inProgress[task.hostname] = task.depth;
+    return true;
+}
+
+//---------------------------------------------------------------------------
+// All queues are empty: read a batch of the oldest sites from disk into the worker's queue.
+//---------------------------------------------------------------------------
+bool Frontier::refill(int worker, SiteTask &task) {
+    if (!spill || spilled == 0) return false;
+    vector<SiteTask> batch;
+    {
+        lock_guard<mutex> lock(spillMutex);
+        size_t limit = min(REFILL_BATCH, max(memoryLimit / queues.size(), size_t(1)));
+        spill->readBatch(limit, batch);
+        spilled = spill->size();                        // lost sites are skipped too
+    }
+    if (batch.empty()) return false;
+
+    // Scored now, with the links counted while they were on disk
+    vector<QueuedSite> sites;
+    for (auto &spilledTask : batch) sites.push_back(queued(spilledTask));
+    WorkerQueue &queue = *queues[worker % queues.size()];
+    lock_guard<mutex> lock(queue.m_mutex);
+    for (auto &site : sites) insert(queue, site);
+    task = removeTop(queue);
+    queue.inProgress[task.hostname] = task.depth;
+    count += batch.size() - 1;
+    return true;
+}
+
+//---------------------------------------------------------------------------
+// The worker is done with a site it popped.
+//---------------------------------------------------------------------------
+void Frontier::complete(int worker, const string &hostname) {
+    shared_lock<shared_mutex> snapshotLock(snapshotMutex);
+    WorkerQueue &queue = *queues[worker % queues.size()];
+    lock_guard<mutex> lock(queue.m_mutex);
+    queue.inProgress.erase(hostname);
+}
+
+//---------------------------------------------------------------------------
+// A link to the site was found. Lock-free, from any thread.
+//---------------------------------------------------------------------------
+void Frontier::countLink(string_view hostname) {
+    uint64_t hash = fingerprint(hostname);
+    for (int row = 0; row < SKETCH_ROWS; row++) {
+        size_t column = size_t((hash >> 32) + row * (hash & 0xffffffff)) % SKETCH_WIDTH;
+        inLinks[row * SKETCH_WIDTH + column].fetch_add(1, memory_order_relaxed);
+    }
+}
+
+//---------------------------------------------------------------------------
+// Links found to the site so far; may be a bit more, never less.
+//---------------------------------------------------------------------------
+uint32_t Frontier::linkCount(string_view hostname) const {
+    uint64_t hash = fingerprint(hostname);
+    uint32_t links = UINT32_MAX;
+    for (int row = 0; row < SKETCH_ROWS; row++) {
+        size_t column = size_t((hash >> 32) + row * (hash & 0xffffffff)) % SKETCH_WIDTH;
+        links = min(links, inLinks[row * SKETCH_WIDTH + column].load(memory_order_relaxed));
+    }
+    return links;
+}
+
+//---------------------------------------------------------------------------
+// Heap order: a lower depth first, then more links, then the one queued first.
+//---------------------------------------------------------------------------
+bool Frontier::lowerPriority(const QueuedSite &a, const QueuedSite &b) {
+    if (a.task.depth != b.task.depth) return a.task.depth > b.task.depth;
+    if (a.inLinks != b.inLinks) return a.inLinks < b.inLinks;
+    return a.order > b.order;
+}
+
+Frontier::QueuedSite Frontier::queued(const SiteTask &task) {
+    return QueuedSite{task, linkCount(task.hostname), nextOrder++};
+}
+
+void Frontier::insert(WorkerQueue &queue, const QueuedSite &site) {
+    queue.tasks.push_back(site);
+    push_heap(queue.tasks.begin(), queue.tasks.end(), lowerPriority);
+}
+
+SiteTask Frontier::removeTop(WorkerQueue &queue) {
+    pop_heap(queue.tasks.begin(), queue.tasks.end(), lowerPriority);
+    SiteTask task = queue.tasks.back().task;
+    queue.tasks.pop_back();
+    return task;
+}
+
+//---------------------------------------------------------------------------
+// Number of sites waiting, over all the workers & on disk.
+//---------------------------------------------------------------------------
+size_t Frontier::size() const {
+    return count + spilled;
+}
+
+size_t Frontier::spilledSize() const {
+    return spilled;
+}
+
+//---------------------------------------------------------------------------
+// Consistent copy of the frontier: no site moves between queues meanwhile.
+// Return an error message if the spill files don't hold all their sites.
+//---------------------------------------------------------------------------
+string Frontier::snapshot(FrontierSnapshot &saved) {
+    unique_lock<shared_mutex> snapshotLock(snapshotMutex);
+    saved.tasks.clear();
+    saved.segments.clear();
+    for (auto &queue : queues) {
+        for (auto &site : queue->inProgress) saved.tasks.push_back(SiteTask{site.first, site.second});
+    }
+    for (auto &queue : queues) {
+        for (auto &site : queue->tasks) saved.tasks.push_back(site.task);
+    }
+    if (!spill) return "";
+    string error = spill->getSegments(saved.segments);
+    if (error.empty()) removableSpillFiles = spill->numConsumed();
+    return error;
+}
+
+//---------------------------------------------------------------------------
+// Continue from a snapshot, before the workers start. The sites in memory are
+// spread over the queues; without a spill directory the spill files are dropped.
+//---------------------------------------------------------------------------
+bool Frontier::restore(const FrontierSnapshot &saved) {
+    unique_lock<shared_mutex> snapshotLock(snapshotMutex);
+    for (size_t i = 0; i < saved.tasks.size(); i++) {
+        insert(*queues[i % queues.size()], queued(saved.tasks[i]));
+        count++;
+    }
+    if (saved.segments.empty()) return true;
+    if (!spill || !spill->restore(saved.segments)) return false;
+    spilled = spill->size();
+    return true;
+}
+
+//---------------------------------------------------------------------------
+// With checkpoints, spill files already read are kept until a snapshot taken
+// after that has been written.
+//---------------------------------------------------------------------------
+void Frontier::keepSpillFiles(bool keep) {
+    if (spill) spill->setKeepConsumed(keep);
+}
+
+void Frontier::checkpointWritten() {
+    if (!spill) return;
+    lock_guard<mutex> lock(spillMutex);
+    spill->removeConsumed(removableSpillFiles);
+    removableSpillFiles = 0;
+}
@@ -0,0 +1,96 @@
+//---------------------------------------------------------------------------
+// Header File for the frontier, the sites waiting to be discovered.
+//---------------------------------------------------------------------------
+
+#ifndef FRONTIER_H
+#define FRONTIER_H
+
+#include <string>
+#include <string_view>
+#include <deque>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <shared_mutex>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+
+using namespace std;
+
+typedef struct {
+    string hostname;
+    int depth;                                          // distance from the starting sites
+} SiteTask;
+
+typedef struct {
+    string name;                                        // file name in the spill directory
+    uint64_t readOffset;                                // bytes already read back
+    uint64_t endOffset;                                 // bytes written
+    uint64_t unread;                                    // sites not read back yet
+} SpillSegment;
+
+// Everything needed to continue a crawl: the sites in memory (the ones in
+// progress first, they start over) & the read positions of the spill files.
+typedef struct {
+    vector<SiteTask> tasks;
+    vector<SpillSegment> segments;
+} FrontierSnapshot;
+
+class SpillStore;
+
+// One queue per worker. A worker takes from its own queue first and steals
+// from the others when it runs dry, so there is no global lock. Past memoryLimit
+// sites, new ones go to append-only files on disk and are read back in batches.
+// Each queue is a heap: the lowest depth first, then the site most linked to
+// (counted in a count-min sketch), then the oldest one.
+class Frontier {
+    public:
+        Frontier(int numWorkers, size_t memoryLimit = 0, const string &spillDirectory = "");
+        ~Frontier();
+        void push(int worker, const SiteTask &task);
+        bool pop(int worker, SiteTask &task);
+        void complete(int worker, const string &hostname);
+        void countLink(string_view hostname);
+        uint32_t linkCount(string_view hostname) const;
+        size_t size() const;
+        size_t spilledSize() const;
+        string snapshot(FrontierSnapshot &saved);
+        bool restore(const FrontierSnapshot &saved);
+        void keepSpillFiles(bool keep);
+        void checkpointWritten();
+    private:
+        typedef struct {
+            SiteTask task;
+            uint32_t inLinks;                           // when queued
+            uint64_t order;                             // queued before the ones with a higher order
+        } QueuedSite;
+
+        typedef struct {
+            mutex m_mutex;
+            vector<QueuedSite> tasks;                   // heap, see lowerPriority
+            map<string, int> inProgress;                // popped, not completed yet
+        } WorkerQueue;
+
+        static constexpr int SKETCH_ROWS = 4;
+        static constexpr size_t SKETCH_WIDTH = 1 << 16;
+
+        vector< unique_ptr<WorkerQueue> > queues;
+        unique_ptr< atomic<uint32_t>[] > inLinks;       // count-min sketch, SKETCH_ROWS x SKETCH_WIDTH
+        atomic<uint64_t> nextOrder;
+        atomic<size_t> count;                           // sites in the queues
+        size_t memoryLimit;
+        unique_ptr<SpillStore> spill;
+        mutex spillMutex;
+        atomic<size_t> spilled;                         // sites in the spill files
+        size_t removableSpillFiles;                     // read before the last snapshot
+        shared_mutex snapshotMutex;                     // shared by all operations, exclusive for snapshots
+        static bool lowerPriority(const QueuedSite &a, const QueuedSite &b);
+        QueuedSite queued(const SiteTask &task);
+        void insert(WorkerQueue &queue, const QueuedSite &site);
+        SiteTask removeTop(WorkerQueue &queue);
+        bool steal(int thief, SiteTask &task);
+        bool refill(int worker, SiteTask &task);
+};
+
+#endif
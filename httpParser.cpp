@@ -0,0 +1,258 @@
+//---------------------------------------------------------------------------
+// C++ Implementation file for the HTTP response parser, to frame responses on a persistent connection.
+// A response ends after Content-Length bytes, after the last chunk, or when the server closes.
+// A body the caller doesn't want is read & dropped if it is small (known length,
+// or chunks adding up to little), otherwise the response is cut short & the
+// connection can't be used any more.
+//---------------------------------------------------------------------------
+
+#include "httpParser.h"
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+
+using namespace std;
+
+// Maximum length of a header line or chunk-size line.
+static const size_t MAX_LINE_LENGTH = 65536;
+
+// Unwanted bodies up to this size are read to keep the connection; larger ones are cut.
+static const size_t DRAIN_LIMIT = 65536;
+
+//---------------------------------------------------------------------------
+// HttpResponseParser constructor
+//---------------------------------------------------------------------------
+HttpResponseParser::HttpResponseParser() {
+    maxBodySize = 0;
+    reset();
+}
+
+void HttpResponseParser::setBodyHandler(function<void(string_view)> onBody) {
+    this->onBody = onBody;
+}
+
+void HttpResponseParser::setMaxBodySize(size_t maxBodySize) {
+    this->maxBodySize = maxBodySize;
+}
+
+//---------------------------------------------------------------------------
+// Get ready for the next response on the connection.
+//---------------------------------------------------------------------------
+void HttpResponseParser::reset() {
+    state = HEADERS;
+    line = "";
+    bytesSeen = 0;
+    remaining = 0;
+    statusCode = 0;
+    http11 = keepAlive = chunked = hasLength = sawHeaderLine = false;
+    contentLength = 0;
+    headers.clear();
+    bodyBytes = 0;
+    discarding = truncated = false;
+    drainedBytes = 0;
+}
+
+//---------------------------------------------------------------------------
+// Consume bytes of the current response. Return how many bytes were used;
+// bytes after the end of the response belong to the next one. Stops right after
+// the headers too, the rest is for the next call.
+//---------------------------------------------------------------------------
+size_t HttpResponseParser::feed(string_view data) {
+    size_t pos = 0, length = data.size();
+    while (pos < length && state != COMPLETE && state != ERROR) {
+        if (state == BODY_LENGTH || state == CHUNK_DATA) {
+            // Raw body bytes
+            size_t n = min(remaining, length - pos);
+            State before = state;
+            deliverBody(data.data() + pos, n);
+            pos += n;
+            remaining -= n;
+            if (state == before && remaining == 0) state = state == BODY_LENGTH ? COMPLETE : CHUNK_END;
+            continue;
+        }
+        if (state == BODY_UNTIL_CLOSE) {
+            deliverBody(data.data() + pos, length - pos);
+            pos = length;
+            continue;
+        }
+
+        // Line based states: assemble one line
+        const char *end = (const char *)memchr(data.data() + pos, '\n', length - pos);
+        size_t n = end == NULL ? length - pos : end - (data.data() + pos);
+        line.append(data.data() + pos, n);
+        pos += n;
+        if (line.size() > MAX_LINE_LENGTH) {
+            state = ERROR;
+            break;
+        }
+        if (end == NULL) break;
+        pos++;
+        if (!line.empty() && line[line.size() - 1] == '\r') line.erase(line.size() - 1);
+        string current;
+        current.swap(line);
+
+        if (state == HEADERS) {
+            if (!sawHeaderLine) {
+                if (current.empty()) continue;              // stray CRLF between responses
+                if (!parseStatusLine(current)) state = ERROR;
+                sawHeaderLine = true;
+            } else if (current.empty()) {
+                startBody();
+                if (state != HEADERS) break;
+            } else {
+                parseHeaderLine(current);
+            }
+        } else if (state == CHUNK_SIZE) {
+            char *last = NULL;
+            remaining = strtoul(current.c_str(), &last, 16);
+            if (last == current.c_str()) state = ERROR;
+                else state = remaining == 0 ? TRAILERS : CHUNK_DATA;
+        } else if (state == CHUNK_END) {
+            state = CHUNK_SIZE;
+        } else if (state == TRAILERS) {
+            if (current.empty()) state = COMPLETE;
+        }
+    }
+    bytesSeen += pos;
+    return pos;
+}
+
+//---------------------------------------------------------------------------
+// The server closed the connection: a body framed by the close is now complete.
+//---------------------------------------------------------------------------
+void HttpResponseParser::finishOnClose() {
+    if (state == BODY_UNTIL_CLOSE) state = COMPLETE;
+        else if (state != COMPLETE && isStarted()) state = ERROR;
+}
+
+//---------------------------------------------------------------------------
+// Body bytes to the handler, up to maxBodySize; the response is cut at the limit.
+//---------------------------------------------------------------------------
+void HttpResponseParser::deliverBody(const char *data, size_t length) {
+    if (length == 0) return;
+    if (discarding) {
+        // Chunks of a skipped body: cut once they add up to more than is worth reading
+        drainedBytes += length;
+        if (chunked && drainedBytes > DRAIN_LIMIT) stopReading();
+        return;
+    }
+    if (maxBodySize > 0 && bodyBytes + length > maxBodySize) {
+        length = maxBodySize - bodyBytes;
+        if (onBody && length > 0) onBody(string_view(data, length));
+        bodyBytes += length;
+        // Cut even if the rest is drained: the caller has only part of the page
+        truncated = true;
+        skipBody();
+        return;
+    }
+    if (onBody) onBody(string_view(data, length));
+    bodyBytes += length;
+}
+
+//---------------------------------------------------------------------------
+// The caller doesn't want the body: drop it if it is small, otherwise stop reading.
+// The size of a chunked body is not known, its chunks are dropped up to DRAIN_LIMIT.
+//---------------------------------------------------------------------------
+void HttpResponseParser::skipBody() {
+    if (state == COMPLETE || state == ERROR) return;
+    if (state == BODY_LENGTH && remaining <= DRAIN_LIMIT) discarding = true;
+        else if (chunked && state != BODY_UNTIL_CLOSE) discarding = true;
+        else stopReading();
+}
+
+void HttpResponseParser::stopReading() {
+    state = COMPLETE;
+    truncated = true;
+    keepAlive = false;
+}
+
+bool HttpResponseParser::isStarted() const { return bytesSeen > 0; }
+bool HttpResponseParser::hasHeaders() const { return state != HEADERS && state != ERROR; }
+bool HttpResponseParser::isTruncated() const { return truncated; }
+bool HttpResponseParser::isComplete() const { return state == COMPLETE; }
+bool HttpResponseParser::hasError() const { return state == ERROR; }
+bool HttpResponseParser::isKeepAlive() const { return keepAlive; }
+int HttpResponseParser::getStatusCode() const { return statusCode; }
+
+//---------------------------------------------------------------------------
+// Value of a header ("" if not sent), name in lowercase.
+//---------------------------------------------------------------------------
+string HttpResponseParser::getHeader(const string &name) const {
+    for (auto &header : headers) {
+        if (header.first == name) return header.second;
+    }
+    return "";
+}
+
+//---------------------------------------------------------------------------
+// Media type without its parameters, in lowercase: "text/html; charset=utf-8" -> "text/html".
+//---------------------------------------------------------------------------
+string HttpResponseParser::getContentType() const {
+    string type = getHeader("content-type");
+    type = type.substr(0, type.find(';'));
+    while (!type.empty() && (type.back() == ' ' || type.back() == '\t')) type.pop_back();
+    transform(type.begin(), type.end(), type.begin(), ::tolower);
+    return type;
+}
+
+//---------------------------------------------------------------------------
+// "HTTP/1.1 200 OK"
+//---------------------------------------------------------------------------
+bool HttpResponseParser::parseStatusLine(const string &line) {
+    if (line.compare(0, 5, "HTTP/") != 0) return false;
+    size_t space = line.find(' ');
+    if (space == string::npos) return false;
+    http11 = line.compare(5, 3, "1.1") == 0;
+    keepAlive = http11;
+    statusCode = atoi(line.c_str() + space + 1);
+    return statusCode > 0;
+}
+
+//---------------------------------------------------------------------------
+// "Name: value". All headers are kept; the ones framing the response are applied.
+//---------------------------------------------------------------------------
+void HttpResponseParser::parseHeaderLine(const string &line) {
+    size_t colon = line.find(':');
+    if (colon == string::npos) return;
+    string name = line.substr(0, colon);
+    transform(name.begin(), name.end(), name.begin(), ::tolower);
+    size_t start = line.find_first_not_of(" \t", colon + 1);
+    string value = start == string::npos ? "" : line.substr(start);
+    while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) value.pop_back();
+    headers.push_back(make_pair(name, value));
+    transform(value.begin(), value.end(), value.begin(), ::tolower);
+
+    if (name == "content-length") {
+        hasLength = true;
+        contentLength = strtoul(value.c_str(), NULL, 10);
+    } else if (name == "transfer-encoding") {
+        chunked = value.find("chunked") != string::npos;
+    } else if (name == "connection") {
+        if (value.find("close") != string::npos) keepAlive = false;
+        if (value.find("keep-alive") != string::npos) keepAlive = true;
+    }
+}
+
+//---------------------------------------------------------------------------
+// Headers are done, decide how the body is framed.
+//---------------------------------------------------------------------------
+void HttpResponseParser::startBody() {
+    if (statusCode >= 100 && statusCode < 200) {
+        // Interim response (100 Continue), the real one follows.
+        statusCode = 0;
+        chunked = hasLength = sawHeaderLine = false;
+        headers.clear();
+        return;
+    }
+    if (statusCode == 204 || statusCode == 304) {
+        state = COMPLETE;
+    } else if (chunked) {
+        state = CHUNK_SIZE;
+    } else if (hasLength) {
+        remaining = contentLength;
+        state = remaining == 0 ? COMPLETE : BODY_LENGTH;
+    } else {
+        state = BODY_UNTIL_CLOSE;
+        keepAlive = false;
+    }
+}
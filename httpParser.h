@@ -0,0 +1,59 @@
+//---------------------------------------------------------------------------
+// Header File for the HTTP response parser, to frame responses on a persistent connection.
+//---------------------------------------------------------------------------
+
+#ifndef HTTPPARSER_H
+#define HTTPPARSER_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <functional>
+#include <cstddef>
+
+using namespace std;
+
+// Body bytes (de-chunked) are handed to the body handler as they arrive. feed()
+// returns right after the headers, so the caller can look at them & skip the body.
+class HttpResponseParser {
+    public:
+        HttpResponseParser();
+        void reset();
+        void setBodyHandler(function<void(string_view)> onBody);
+        void setMaxBodySize(size_t maxBodySize);
+        size_t feed(string_view data);
+        void finishOnClose();
+        void skipBody();
+        bool isStarted() const;
+        bool hasHeaders() const;
+        bool isComplete() const;
+        bool isTruncated() const;
+        bool hasError() const;
+        bool isKeepAlive() const;
+        int getStatusCode() const;
+        string getHeader(const string &name) const;
+        string getContentType() const;
+    private:
+        enum State { HEADERS, BODY_LENGTH, BODY_UNTIL_CLOSE, CHUNK_SIZE, CHUNK_DATA, CHUNK_END, TRAILERS, COMPLETE, ERROR };
+        State state;
+        string line;                // header / chunk-size line being assembled
+        size_t bytesSeen;
+        size_t remaining;           // bytes left of the body or of the current chunk
+        int statusCode;
+        bool http11, keepAlive, chunked, hasLength, sawHeaderLine;
+        size_t contentLength;
+        vector< pair<string, string> > headers;         // lowercase name, value as sent
+        function<void(string_view)> onBody;
+        size_t maxBodySize;         // 0 for no limit
+        size_t bodyBytes;           // delivered to the body handler
+        bool discarding;            // body read but not delivered
+        size_t drainedBytes;        // of the body read but not delivered
+        bool truncated;             // the caller didn't get the whole body (size limit, or not read to the end)
+        bool parseStatusLine(const string &line);
+        void parseHeaderLine(const string &line);
+        void startBody();
+        void deliverBody(const char *data, size_t length);
+        void stopReading();
+};
+
+#endif
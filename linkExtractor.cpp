@@ -0,0 +1,183 @@
+//---------------------------------------------------------------------------
+// C++ Implementation file for the link extractor, a streaming single pass URL finder.
+// Finds href = "...", http://... and https://... in one linear scan; data can be fed
+// in chunks as it arrives from the socket, a URL may span two chunks.
+//---------------------------------------------------------------------------
+
+#include "linkExtractor.h"
+#include "parser.h"
+#include "urlFilter.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+// Longer URLs are dropped, they are almost always inline data or scripts.
+static const size_t MAX_URL_LENGTH = 2048;
+
+//---------------------------------------------------------------------------
+// As the raw HTTP response contains a lot of special character \0 \1 \t etc.
+// each byte is mapped to its lowercase form, to ' ' for separators, or to 0 to skip it.
+//---------------------------------------------------------------------------
+struct CharTable {
+    char map[256];
+    CharTable() {
+        string allowedChrs = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789.,/\"':#?+-_= ";
+        for (int i = 0; i < 256; i++) map[i] = 0;
+        for (char ch : allowedChrs) map[(unsigned char)ch] = tolower(ch);
+        for (char ch : string("\n\r\t<>")) map[(unsigned char)ch] = ' ';
+    }
+};
+static const CharTable charTable;
+
+//---------------------------------------------------------------------------
+// LinkExtractor constructor
+//---------------------------------------------------------------------------
+LinkExtractor::LinkExtractor() {
+    reset();
+}
+
+//---------------------------------------------------------------------------
+// Forget the current document and the URLs found so far.
+//---------------------------------------------------------------------------
+void LinkExtractor::reset() {
+    state = IDLE;
+    url.clear();
+    clearUrls();
+}
+
+//---------------------------------------------------------------------------
+// Scan the next chunk of the document.
+//---------------------------------------------------------------------------
+void LinkExtractor::feed(string_view data) {
+    size_t pos = 0, length = data.size();
+    while (pos < length) {
+        // Outside of a pattern only 'h' matters, jump straight to the next one.
+        if (state == IDLE) {
+            pos += skipIdle(data.data() + pos, length - pos);
+            if (pos >= length) break;
+        }
+        char ch = charTable.map[(unsigned char)data[pos++]];
+        if (ch) step(ch);
+    }
+}
+
+//---------------------------------------------------------------------------
+// End of the document: a URL running to the end is complete.
+//---------------------------------------------------------------------------
+void LinkExtractor::finish() {
+    if (state == URL) emitUrl();
+    state = IDLE;
+}
+
+//---------------------------------------------------------------------------
+// All the URLs found as <hostname, path>, in document order.
+//---------------------------------------------------------------------------
+const vector< pair<string_view, string_view> > &LinkExtractor::getUrls() const {
+    return extractedUrls;
+}
+
+//---------------------------------------------------------------------------
+// Done with the URLs of the page: their memory is used for the next one.
+//---------------------------------------------------------------------------
+void LinkExtractor::clearUrls() {
+    extractedUrls.clear();
+    pageUrls.clear();
+}
+
+//---------------------------------------------------------------------------
+// Number of bytes before the next 'h' or 'H', 16 bytes at a time with SSE2.
+//---------------------------------------------------------------------------
+size_t LinkExtractor::skipIdle(const char *data, size_t length) {
+    size_t pos = 0;
+#ifdef __SSE2__
+    const __m128i lower = _mm_set1_epi8('h'), upper = _mm_set1_epi8('H');
+    for (; pos + 16 <= length; pos += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i *)(data + pos));
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, lower), _mm_cmpeq_epi8(block, upper)));
+        if (mask != 0) return pos + __builtin_ctz(mask);
+    }
+#endif
+    for (; pos < length; pos++) {
+        if (data[pos] == 'h' || data[pos] == 'H') return pos;
+    }
+    return length;
+}
+
+//---------------------------------------------------------------------------
+// Advance the pattern matcher by one (mapped) character.
+//---------------------------------------------------------------------------
+void LinkExtractor::step(char ch) {
+    switch (state) {
+        case IDLE:
+            if (ch == 'h') state = H;
+            return;
+        case H:
+            if (ch == 'r') { state = HR; return; }
+            if (ch == 't') { state = HT; return; }
+            break;
+        case HR:
+            if (ch == 'e') { state = HRE; return; }
+            break;
+        case HRE:
+            if (ch == 'f') { state = HREF; return; }
+            break;
+        case HREF:
+            if (ch == ' ') return;
+            if (ch == '=') { state = HREF_EQUAL; return; }
+            break;
+        case HREF_EQUAL:
+            if (ch == ' ') return;
+            if (ch == '"' || ch == '\'') { state = URL; url.clear(); return; }
+            break;
+        case HT:
+            if (ch == 't') { state = HTT; return; }
+            break;
+        case HTT:
+            if (ch == 'p') { state = HTTP; url = "http"; return; }
+            break;
+        case HTTP:
+            if (ch == 's') { state = HTTPS; url = "https"; return; }
+            if (ch == ':') { state = SCHEME_COLON; url += ch; return; }
+            break;
+        case HTTPS:
+            if (ch == ':') { state = SCHEME_COLON; url += ch; return; }
+            break;
+        case SCHEME_COLON:
+            if (ch == '/') { state = SCHEME_SLASH; url += ch; return; }
+            break;
+        case SCHEME_SLASH:
+            if (ch == '/') { state = URL; url += ch; return; }
+            break;
+        case URL:
+            // URL's possible ending, includes #, ? for not counting the hash & query.
+            if (ch == '"' || ch == '\'' || ch == '#' || ch == '?' || ch == ',' || ch == ' ') {
+                emitUrl();
+                state = IDLE;
+            } else if (url.size() < MAX_URL_LENGTH) {
+                url += ch;
+            } else {
+                url.clear();
+                state = IDLE;
+            }
+            return;
+    }
+
+    // Not a pattern after all, this character may start a new one.
+    state = ch == 'h' ? H : IDLE;
+}
+
+//---------------------------------------------------------------------------
+// Verify and Add to the list, the first time the URL is seen on the page
+//---------------------------------------------------------------------------
+void LinkExtractor::emitUrl() {
+    bool inserted = false;
+    string_view stored = url.empty() ? string_view() : pageUrls.intern(url, inserted);
+    if (inserted) {
+        string_view hostname, path;
+        splitUrl(stored, hostname, path);
+        if (UrlFilter::instance().accept(hostname, path)) extractedUrls.push_back(make_pair(hostname, path));
+    }
+    url.clear();
+}
@@ -0,0 +1,38 @@
+//---------------------------------------------------------------------------
+// Header File for the link extractor, a streaming single pass URL finder.
+//---------------------------------------------------------------------------
+
+#ifndef LINKEXTRACTOR_H
+#define LINKEXTRACTOR_H
+
+#include "stringArena.h"
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+// The URLs found are interned in a per-page table: a link repeated on the page
+// is reported once, and nothing is allocated per link once the table is warm.
+// The <hostname, path> views stay valid until clearUrls() or reset().
+class LinkExtractor {
+    public:
+        LinkExtractor();
+        void reset();
+        void feed(string_view data);
+        void finish();
+        const vector< pair<string_view, string_view> > &getUrls() const;
+        void clearUrls();
+    private:
+        // Position inside the start patterns: href = "..." or http(s)://...
+        enum State { IDLE, H, HR, HRE, HREF, HREF_EQUAL, HT, HTT, HTTP, HTTPS, SCHEME_COLON, SCHEME_SLASH, URL };
+        State state;
+        string url;                                     // URL being read, may span several chunks
+        StringTable pageUrls;                           // URLs of the page, the storage of extractedUrls
+        vector< pair<string_view, string_view> > extractedUrls;   // <hostname, path>
+        size_t skipIdle(const char *data, size_t length);
+        void step(char ch);
+        void emitUrl();
+};
+
+#endif
@@ -0,0 +1,302 @@
+//---------------------------------------------------------------------------
+// C++ Implementation file for the link graph, its CSR file & the mmap reader.
+//---------------------------------------------------------------------------
+
+#include "linkGraph.h"
+#include "serialize.h"
+#include <fstream>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+static const char MAGIC[] = "LINKCSR1";
+
+//---------------------------------------------------------------------------
+// Sequential writes to the graph file, keeping track of the offset.
+//---------------------------------------------------------------------------
+static void put(ofstream &file, uint64_t &offset, const void *data, size_t size) {
+    file.write((const char *)data, size);
+    offset += size;
+}
+
+static void align(ofstream &file, uint64_t &offset) {
+    static const char zeros[8] = {0};
+    put(file, offset, zeros, (8 - offset % 8) % 8);
+}
+
+//---------------------------------------------------------------------------
+// Offsets & bytes of a list of names.
+//---------------------------------------------------------------------------
+static void writeNames(ofstream &file, uint64_t &offset, const vector<uint64_t> &offsets, string_view bytes) {
+    put(file, offset, offsets.data(), offsets.size() * sizeof(uint64_t));
+    put(file, offset, bytes.data(), bytes.size());
+    align(file, offset);
+}
+
+//---------------------------------------------------------------------------
+// CSR rows of the links (sorted & deduplicated first), gaps between targets as varints.
+// Return the number of distinct links.
+//---------------------------------------------------------------------------
+static uint64_t writeLinks(ofstream &file, uint64_t &offset, vector< pair<uint32_t, uint32_t> > &links, size_t numNodes) {
+    sort(links.begin(), links.end());
+    links.erase(unique(links.begin(), links.end()), links.end());
+    vector<uint64_t> rows(numNodes + 1);
+    string bytes;
+    size_t i = 0;
+    for (size_t node = 0; node < numNodes; node++) {
+        rows[node] = bytes.size();
+        uint32_t previous = 0;
+        for (; i < links.size() && links[i].first == node; i++) {
+            appendVarint(bytes, links[i].second - previous);
+            previous = links[i].second;
+        }
+    }
+    rows[numNodes] = bytes.size();
+    writeNames(file, offset, rows, bytes);
+    return links.size();
+}
+
+//---------------------------------------------------------------------------
+// LinkGraphBuilder constructor
+//---------------------------------------------------------------------------
+LinkGraphBuilder::LinkGraphBuilder() {
+    this->pageOffsets.push_back(0);
+}
+
+//---------------------------------------------------------------------------
+// A finished site: its pages & their links, and a host link to each linked site.
+//---------------------------------------------------------------------------
+void LinkGraphBuilder::addSite(const SiteStats &stats, int depth) {
+    uint32_t id = hostId(stats.hostname);
+    unordered_map<string_view, double> responseTimes;
+    for (auto &page : stats.discoveredPages) responseTimes[page.first] = page.second;
+
+    LinkGraphHost &host = hosts[id];
+    host.depth = depth;
+    host.pagesDiscovered = uint32_t(stats.discoveredPages.size());
+    host.pagesFailed = uint32_t(stats.numberOfPagesFailed);
+    host.averageResponseTime = float(stats.averageResponseTime);
+    host.firstPage = pages.size();
+    host.numPages = stats.graphPages.size();
+    for (auto path : stats.graphPages) {
+        auto time = responseTimes.find(path);
+        pages.push_back(LinkGraphPage{id, time == responseTimes.end() ? -1 : float(time->second)});
+        pageNames.append(path.data(), path.size());
+        pageOffsets.push_back(pageNames.size());
+    }
+    uint32_t firstPage = uint32_t(host.firstPage);
+    for (auto &link : stats.graphLinks) pageLinks.push_back(make_pair(firstPage + link.first, firstPage + link.second));
+    for (auto site : stats.linkedSites) {
+        uint32_t target = hostId(site);
+        hostLinks.push_back(make_pair(id, target));
+    }
+}
+
+//---------------------------------------------------------------------------
+// Write the graph, to a temporary file renamed at the end. Return Error Description or "".
+//---------------------------------------------------------------------------
+string LinkGraphBuilder::write(const string &path) {
+    string tempPath = path + ".tmp";
+    ofstream file(tempPath, ios::binary | ios::trunc);
+    if (!file) return "Cannot create " + tempPath + "!";
+
+    LinkGraphHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAGIC, sizeof(header.magic));
+    header.numHosts = hosts.size();
+    header.numPages = pages.size();
+    uint64_t offset = 0;
+    put(file, offset, &header, sizeof(header));
+
+    vector<uint64_t> hostOffsets(1, 0);
+    string hostBytes;
+    for (auto name : hostNames) {
+        hostBytes.append(name.data(), name.size());
+        hostOffsets.push_back(hostBytes.size());
+    }
+    header.hostNames = offset;
+    writeNames(file, offset, hostOffsets, hostBytes);
+    header.hostInfo = offset;
+    put(file, offset, hosts.data(), hosts.size() * sizeof(LinkGraphHost));
+    header.hostLinks = offset;
+    header.numHostLinks = writeLinks(file, offset, hostLinks, hosts.size());
+
+    header.pageNames = offset;
+    writeNames(file, offset, pageOffsets, pageNames);
+    header.pageInfo = offset;
+    put(file, offset, pages.data(), pages.size() * sizeof(LinkGraphPage));
+    align(file, offset);
+    header.pageLinks = offset;
+    header.numPageLinks = writeLinks(file, offset, pageLinks, pages.size());
+    header.fileSize = offset;
+
+    file.seekp(0);
+    file.write((const char *)&header, sizeof(header));
+    file.flush();
+    if (!file) return "Cannot write " + tempPath + "!";
+    file.close();
+    if (rename(tempPath.c_str(), path.c_str()) != 0) return "Cannot rename " + tempPath + "!";
+    return "";
+}
+
+uint64_t LinkGraphBuilder::getHosts() const {
+    return hosts.size();
+}
+
+uint64_t LinkGraphBuilder::getPages() const {
+    return pages.size();
+}
+
+//---------------------------------------------------------------------------
+// Id of a host, numbered at its first sight (as a site not crawled yet).
+//---------------------------------------------------------------------------
+uint32_t LinkGraphBuilder::hostId(string_view hostname) {
+    auto found = hostIds.find(hostname);
+    if (found != hostIds.end()) return found->second;
+    string_view stored = hostTable.intern(hostname);
+    uint32_t id = uint32_t(hosts.size());
+    hostIds[stored] = id;
+    hostNames.push_back(stored);
+    hosts.push_back(LinkGraphHost{-1, 0, 0, -1, pages.size(), 0});
+    return id;
+}
+
+//---------------------------------------------------------------------------
+// LinkGraph constructor
+//---------------------------------------------------------------------------
+LinkGraph::LinkGraph() {
+    this->data = NULL;
+    this->size = 0;
+    this->header = NULL;
+}
+
+LinkGraph::~LinkGraph() {
+    close();
+}
+
+//---------------------------------------------------------------------------
+// Map a graph file & check its sections fit in it. Return Error Description or "".
+//---------------------------------------------------------------------------
+string LinkGraph::open(const string &path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return "Cannot open " + path + "!";
+    struct stat info;
+    if (fstat(fd, &info) != 0 || size_t(info.st_size) < sizeof(LinkGraphHeader)) {
+        ::close(fd);
+        return path + " is not a link graph!";
+    }
+    void *mapped = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) return "Cannot map " + path + "!";
+    data = (const char *)mapped;
+    size = info.st_size;
+    header = (const LinkGraphHeader *)data;
+
+    string error;
+    if (memcmp(header->magic, MAGIC, sizeof(header->magic)) != 0 || header->fileSize != size) error = path + " is not a link graph!";
+    if (error.empty()) error = mapSection(header->hostNames, header->numHosts, hostNameSection);
+    if (error.empty()) error = mapSection(header->hostLinks, header->numHosts, hostLinkSection);
+    if (error.empty()) error = mapSection(header->pageNames, header->numPages, pageNameSection);
+    if (error.empty()) error = mapSection(header->pageLinks, header->numPages, pageLinkSection);
+    bool infoFits = header->hostInfo % 8 == 0 && header->hostInfo + header->numHosts * sizeof(LinkGraphHost) <= size
+        && header->pageInfo % 8 == 0 && header->pageInfo + header->numPages * sizeof(LinkGraphPage) <= size;
+    if (error.empty() && !infoFits) error = path + " is truncated!";
+    if (!error.empty()) close();
+    return error;
+}
+
+void LinkGraph::close() {
+    if (data) munmap((void *)data, size);
+    data = NULL;
+    size = 0;
+    header = NULL;
+}
+
+uint64_t LinkGraph::numHosts() const {
+    return header ? header->numHosts : 0;
+}
+
+uint64_t LinkGraph::numHostLinks() const {
+    return header ? header->numHostLinks : 0;
+}
+
+uint64_t LinkGraph::numPages() const {
+    return header ? header->numPages : 0;
+}
+
+uint64_t LinkGraph::numPageLinks() const {
+    return header ? header->numPageLinks : 0;
+}
+
+string_view LinkGraph::hostName(uint32_t host) const {
+    return entry(hostNameSection, host);
+}
+
+const LinkGraphHost &LinkGraph::hostInfo(uint32_t host) const {
+    return ((const LinkGraphHost *)(data + header->hostInfo))[host];
+}
+
+void LinkGraph::hostLinks(uint32_t host, vector<uint32_t> &targets) const {
+    decodeLinks(entry(hostLinkSection, host), targets);
+}
+
+//---------------------------------------------------------------------------
+// Id of a host by name, -1 if it is not in the graph. Goes through all the names.
+//---------------------------------------------------------------------------
+int64_t LinkGraph::findHost(string_view hostname) const {
+    for (uint64_t host = 0; host < numHosts(); host++) {
+        if (hostName(host) == hostname) return int64_t(host);
+    }
+    return -1;
+}
+
+string_view LinkGraph::pageName(uint32_t page) const {
+    return entry(pageNameSection, page);
+}
+
+const LinkGraphPage &LinkGraph::pageInfo(uint32_t page) const {
+    return ((const LinkGraphPage *)(data + header->pageInfo))[page];
+}
+
+void LinkGraph::pageLinks(uint32_t page, vector<uint32_t> &targets) const {
+    decodeLinks(entry(pageLinkSection, page), targets);
+}
+
+//---------------------------------------------------------------------------
+// Offsets array of count entries (+1) at offset, with all its bytes inside the file.
+//---------------------------------------------------------------------------
+string LinkGraph::mapSection(uint64_t offset, uint64_t count, Section &section) const {
+    uint64_t bytesStart = offset + (count + 1) * sizeof(uint64_t);
+    if (offset % 8 != 0 || count >= size || bytesStart > size) return "Link graph section out of the file!";
+    section.offsets = (const uint64_t *)(data + offset);
+    section.bytes = data + bytesStart;
+    section.count = count;
+    if (section.offsets[0] != 0 || section.offsets[count] > size - bytesStart) return "Link graph section out of the file!";
+    return "";
+}
+
+//---------------------------------------------------------------------------
+// Bytes of the i-th entry; empty if it is out of range or its offsets are not.
+//---------------------------------------------------------------------------
+string_view LinkGraph::entry(const Section &section, uint64_t i) {
+    if (i >= section.count) return string_view();
+    uint64_t start = section.offsets[i], end = section.offsets[i + 1];
+    if (start > end || end > section.offsets[section.count]) return string_view();
+    return string_view(section.bytes + start, end - start);
+}
+
+void LinkGraph::decodeLinks(string_view row, vector<uint32_t> &targets) {
+    targets.clear();
+    uint64_t target = 0, gap;
+    while (readVarint(row, gap)) {
+        target += gap;
+        targets.push_back(uint32_t(target));
+    }
+}
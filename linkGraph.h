@@ -0,0 +1,110 @@
+//---------------------------------------------------------------------------
+// Header File for the link graph: hosts & pages with their links, written at the
+// end of a crawl as a CSR file that is read back with a single mmap.
+//---------------------------------------------------------------------------
+
+#ifndef LINKGRAPH_H
+#define LINKGRAPH_H
+
+#include "clientSocket.h"
+#include "stringArena.h"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+using namespace std;
+
+// File layout, integers in host order, every section starting 8 byte aligned:
+//   LinkGraphHeader
+//   host names - u64 offsets[numHosts + 1] into the name bytes that follow
+//   host info  - LinkGraphHost[numHosts]
+//   host links - u64 rows[numHosts + 1] into the bytes that follow; a row holds the
+//                sorted ids of the targets, each as the varint of its gap to the previous one
+//   page names, page info (LinkGraphPage[numPages]), page links - the same for the pages
+// Hosts are numbered in order of first sight; the pages of a host are consecutive.
+typedef struct {
+    char magic[8];                                      // "LINKCSR1"
+    uint64_t numHosts, numHostLinks;
+    uint64_t numPages, numPageLinks;
+    uint64_t hostNames, hostInfo, hostLinks;            // offsets of the sections
+    uint64_t pageNames, pageInfo, pageLinks;
+    uint64_t fileSize;
+} LinkGraphHeader;
+
+typedef struct {
+    int32_t depth;                                      // -1 for a site linked to but not crawled
+    uint32_t pagesDiscovered;
+    uint32_t pagesFailed;
+    float averageResponseTime;                          // ms, -1 without pages
+    uint64_t firstPage;                                 // pages of the host: [firstPage, firstPage + numPages)
+    uint64_t numPages;
+} LinkGraphHost;
+
+typedef struct {
+    uint32_t host;
+    float responseTime;                                 // ms, -1 if not fetched (failed, skipped, past pagesLimit)
+} LinkGraphPage;
+
+// Collects the finished sites on the result writer thread, then writes the file.
+// Host links are every linked site, page links stay within a host.
+class LinkGraphBuilder {
+    public:
+        LinkGraphBuilder();
+        void addSite(const SiteStats &stats, int depth);
+        string write(const string &path);
+        uint64_t getHosts() const;
+        uint64_t getPages() const;
+    private:
+        StringTable hostTable;
+        unordered_map<string_view, uint32_t> hostIds;   // views into hostTable
+        vector<string_view> hostNames;
+        vector<LinkGraphHost> hosts;
+        vector< pair<uint32_t, uint32_t> > hostLinks;
+        string pageNames;                               // paths of all the pages, back to back
+        vector<uint64_t> pageOffsets;
+        vector<LinkGraphPage> pages;
+        vector< pair<uint32_t, uint32_t> > pageLinks;
+
+        uint32_t hostId(string_view hostname);
+};
+
+// Read-only view of a link graph file. Loading maps the file & checks its header,
+// nothing is parsed; the links of a node are decoded when asked for.
+class LinkGraph {
+    public:
+        LinkGraph();
+        ~LinkGraph();
+        string open(const string &path);
+        void close();
+        uint64_t numHosts() const;
+        uint64_t numHostLinks() const;
+        uint64_t numPages() const;
+        uint64_t numPageLinks() const;
+        string_view hostName(uint32_t host) const;
+        const LinkGraphHost &hostInfo(uint32_t host) const;
+        void hostLinks(uint32_t host, vector<uint32_t> &targets) const;
+        int64_t findHost(string_view hostname) const;
+        string_view pageName(uint32_t page) const;
+        const LinkGraphPage &pageInfo(uint32_t page) const;
+        void pageLinks(uint32_t page, vector<uint32_t> &targets) const;
+    private:
+        // Offsets array & the bytes it points into
+        typedef struct {
+            const uint64_t *offsets;
+            const char *bytes;
+            uint64_t count;
+        } Section;
+
+        const char *data;
+        size_t size;
+        const LinkGraphHeader *header;
+        Section hostNameSection, hostLinkSection, pageNameSection, pageLinkSection;
+
+        string mapSection(uint64_t offset, uint64_t count, Section &section) const;
+        static string_view entry(const Section &section, uint64_t i);
+        static void decodeLinks(string_view row, vector<uint32_t> &targets);
+};
+
+#endif
@@ -0,0 +1,104 @@
+//---------------------------------------------------------------------------
+// Link graph reader: maps a linkGraphFile written by the crawler & prints it.
+//
+// ./linkGraphTool <graph file> [--top 10] [--host hostname]
+//   the counts of the graph, the hosts with the most in-links & the details of one host
+//---------------------------------------------------------------------------
+
+#include "linkGraph.h"
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+
+using namespace std;
+using namespace std::chrono;
+
+//---------------------------------------------------------------------------
+// Hosts with the most links pointing to them, decoding every row once.
+//---------------------------------------------------------------------------
+static void printTopHosts(const LinkGraph &graph, int top) {
+    vector<uint32_t> inLinks(graph.numHosts(), 0), targets;
+    for (uint64_t host = 0; host < graph.numHosts(); host++) {
+        graph.hostLinks(host, targets);
+        for (auto target : targets) if (target < inLinks.size()) inLinks[target]++;
+    }
+    vector<uint32_t> order(graph.numHosts());
+    for (uint32_t i = 0; i < order.size(); i++) order[i] = i;
+    int count = min(top, int(order.size()));
+    partial_sort(order.begin(), order.begin() + count, order.end(), [&inLinks](uint32_t a, uint32_t b) { return inLinks[a] > inLinks[b]; });
+    cout << "Most linked hosts:" << endl;
+    for (int i = 0; i < count; i++) {
+        const LinkGraphHost &info = graph.hostInfo(order[i]);
+        cout << "  " << setw(8) << inLinks[order[i]] << "  " << graph.hostName(order[i]);
+        if (info.depth < 0) cout << " (not crawled)";
+        cout << endl;
+    }
+}
+
+//---------------------------------------------------------------------------
+// One host: its metadata, the hosts it links to & its pages with their links.
+//---------------------------------------------------------------------------
+static void printHost(const LinkGraph &graph, uint32_t host) {
+    const LinkGraphHost &info = graph.hostInfo(host);
+    vector<uint32_t> targets;
+    cout << "Host " << host << ": " << graph.hostName(host) << endl;
+    cout << "  depth " << info.depth << ", " << info.pagesDiscovered << " pages discovered, " << info.pagesFailed
+         << " failed, average response time " << info.averageResponseTime << " ms" << endl;
+    graph.hostLinks(host, targets);
+    cout << "  links to " << targets.size() << " hosts:";
+    for (auto target : targets) cout << " " << graph.hostName(target);
+    cout << endl;
+    cout << "  " << info.numPages << " pages:" << endl;
+    for (uint64_t page = info.firstPage; page < info.firstPage + info.numPages; page++) {
+        const LinkGraphPage &pageInfo = graph.pageInfo(page);
+        graph.pageLinks(page, targets);
+        cout << "    " << graph.pageName(page);
+        if (pageInfo.responseTime >= 0) cout << " (" << pageInfo.responseTime << " ms)";
+            else cout << " (not fetched)";
+        cout << " ->";
+        for (auto target : targets) cout << " " << graph.pageName(target);
+        cout << endl;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        cerr << "Usage: " << argv[0] << " <graph file> [--top 10] [--host hostname]" << endl;
+        return 1;
+    }
+    int top = 10;
+    string hostname;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        string name = argv[i], value = argv[i + 1];
+        if (name == "--top") top = stoi(value);
+        else if (name == "--host") hostname = value;
+    }
+
+    LinkGraph graph;
+    steady_clock::time_point start = steady_clock::now();
+    string error = graph.open(argv[1]);
+    double loadMicros = duration<double, micro>(steady_clock::now() - start).count();
+    if (!error.empty()) {
+        cerr << "Error: " << error << endl;
+        return 1;
+    }
+    uint64_t crawled = 0;
+    for (uint64_t host = 0; host < graph.numHosts(); host++) if (graph.hostInfo(host).depth >= 0) crawled++;
+    cout << graph.numHosts() << " hosts (" << crawled << " crawled), " << graph.numHostLinks() << " host links, "
+         << graph.numPages() << " pages, " << graph.numPageLinks() << " page links; loaded in "
+         << fixed << setprecision(1) << loadMicros << " us" << endl;
+    cout.unsetf(ios::fixed);
+    if (top > 0) printTopHosts(graph, top);
+    if (!hostname.empty()) {
+        int64_t host = graph.findHost(hostname);
+        if (host < 0) {
+            cerr << "Error: " << hostname << " is not in the graph!" << endl;
+            return 1;
+        }
+        printHost(graph, uint32_t(host));
+    }
+    return 0;
+}
@@ -0,0 +1,163 @@
+//---------------------------------------------------------------------------
+// C++ Implementation file for fetch metrics: phase histograms, counters & the periodic dump.
+//---------------------------------------------------------------------------
+
+#include "metrics.h"
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+using namespace std;
+
+const char *PHASE_NAMES[NUM_PHASES] = {"dns", "connect", "ttfb", "transfer", "parse"};
+const char *FAILURE_NAMES[NUM_FAILURE_CAUSES] = {"dns", "connect", "send", "recv", "timeout", "parse", "status"};
+
+// Quantiles written for each phase
+static const double QUANTILES[] = {50, 90, 99, 99.9};
+
+//---------------------------------------------------------------------------
+// The process-wide metrics.
+//---------------------------------------------------------------------------
+Metrics &Metrics::instance() {
+    static Metrics metrics;
+    return metrics;
+}
+
+Metrics::Metrics() {
+    for (auto &failure : failures) failure = 0;
+    for (auto &responses : responsesByClass) responses = 0;
+    bytesSent = bytesReceived = requests = retries = connectionsOpened = 0;
+    redirects = skippedPages = truncatedPages = 0;
+    openConnections = 0;
+}
+
+void Metrics::recordPhase(FetchPhase phase, uint64_t micros) {
+    phases[phase].record(micros);
+}
+
+void Metrics::countFailure(FailureCause cause) {
+    failures[cause].fetch_add(1, memory_order_relaxed);
+}
+
+void Metrics::countResponse(int statusCode) {
+    int statusClass = statusCode / 100;
+    responsesByClass[statusClass >= 1 && statusClass <= 5 ? statusClass : 0].fetch_add(1, memory_order_relaxed);
+}
+
+void Metrics::addBytesSent(uint64_t bytes) { bytesSent.fetch_add(bytes, memory_order_relaxed); }
+void Metrics::addBytesReceived(uint64_t bytes) { bytesReceived.fetch_add(bytes, memory_order_relaxed); }
+void Metrics::countRequests(uint64_t count) { requests.fetch_add(count, memory_order_relaxed); }
+void Metrics::countRetries(uint64_t pages) { retries.fetch_add(pages, memory_order_relaxed); }
+
+void Metrics::countRedirect() { redirects.fetch_add(1, memory_order_relaxed); }
+void Metrics::countSkipped() { skippedPages.fetch_add(1, memory_order_relaxed); }
+void Metrics::countTruncated() { truncatedPages.fetch_add(1, memory_order_relaxed); }
+
+void Metrics::countConnection(int delta) {
+    if (delta > 0) connectionsOpened.fetch_add(1, memory_order_relaxed);
+    openConnections.fetch_add(delta, memory_order_relaxed);
+}
+
+//---------------------------------------------------------------------------
+// Text of all the metrics: "prometheus" (text exposition format) or "json".
+//---------------------------------------------------------------------------
+string Metrics::render(const string &format, const vector<Gauge> &gauges) {
+    ostringstream out;
+    if (format == "json") {
+        out << "{\"phases\":{";
+        for (int phase = 0; phase < NUM_PHASES; phase++) {
+            SharedHistogram &histogram = phases[phase];
+            out << (phase ? "," : "") << "\"" << PHASE_NAMES[phase] << "\":{\"count\":" << histogram.count()
+                << ",\"sum_ms\":" << histogram.valueSum() / 1000.0 << ",\"max_ms\":" << histogram.maximum() / 1000.0;
+            for (double q : QUANTILES) out << ",\"p" << q << "_ms\":" << histogram.percentile(q) / 1000.0;
+            out << "}";
+        }
+        out << "},\"failures\":{";
+        for (int cause = 0; cause < NUM_FAILURE_CAUSES; cause++) out << (cause ? "," : "") << "\"" << FAILURE_NAMES[cause] << "\":" << failures[cause];
+        out << "},\"responses\":{\"other\":" << responsesByClass[0];
+        for (int statusClass = 1; statusClass <= 5; statusClass++) out << ",\"" << statusClass << "xx\":" << responsesByClass[statusClass];
+        out << "},\"bytes_sent\":" << bytesSent << ",\"bytes_received\":" << bytesReceived << ",\"requests\":" << requests
+            << ",\"retries\":" << retries << ",\"connections_opened\":" << connectionsOpened << ",\"open_connections\":" << openConnections
+            << ",\"redirects\":" << redirects << ",\"skipped_pages\":" << skippedPages << ",\"truncated_pages\":" << truncatedPages;
+        for (auto &gauge : gauges) out << ",\"" << gauge.name << "\":" << gauge.value;
+        out << "}\n";
+        return out.str();
+    }
+
+    out << "# HELP crawler_phase_seconds Time of each fetch phase.\n# TYPE crawler_phase_seconds summary\n";
+    for (int phase = 0; phase < NUM_PHASES; phase++) {
+        SharedHistogram &histogram = phases[phase];
+        for (double q : QUANTILES) {
+            out << "crawler_phase_seconds{phase=\"" << PHASE_NAMES[phase] << "\",quantile=\"" << q / 100 << "\"} " << histogram.percentile(q) / 1e6 << "\n";
+        }
+        out << "crawler_phase_seconds_sum{phase=\"" << PHASE_NAMES[phase] << "\"} " << histogram.valueSum() / 1e6 << "\n";
+        out << "crawler_phase_seconds_count{phase=\"" << PHASE_NAMES[phase] << "\"} " << histogram.count() << "\n";
+    }
+    out << "# HELP crawler_failed_pages_total Pages failed, by cause.\n# TYPE crawler_failed_pages_total counter\n";
+    for (int cause = 0; cause < NUM_FAILURE_CAUSES; cause++) {
+        out << "crawler_failed_pages_total{cause=\"" << FAILURE_NAMES[cause] << "\"} " << failures[cause] << "\n";
+    }
+    out << "# HELP crawler_responses_total Responses received, by status class.\n# TYPE crawler_responses_total counter\n";
+    out << "crawler_responses_total{class=\"other\"} " << responsesByClass[0] << "\n";
+    for (int statusClass = 1; statusClass <= 5; statusClass++) {
+        out << "crawler_responses_total{class=\"" << statusClass << "xx\"} " << responsesByClass[statusClass] << "\n";
+    }
+    out << "# TYPE crawler_bytes_sent_total counter\ncrawler_bytes_sent_total " << bytesSent << "\n";
+    out << "# TYPE crawler_bytes_received_total counter\ncrawler_bytes_received_total " << bytesReceived << "\n";
+    out << "# TYPE crawler_requests_total counter\ncrawler_requests_total " << requests << "\n";
+    out << "# HELP crawler_retried_pages_total Pages requested again after their connection was lost.\n# TYPE crawler_retried_pages_total counter\n";
+    out << "crawler_retried_pages_total " << retries << "\n";
+    out << "# HELP crawler_redirects_total Redirects followed.\n# TYPE crawler_redirects_total counter\ncrawler_redirects_total " << redirects << "\n";
+    out << "# HELP crawler_skipped_pages_total Answers that are not HTML, body skipped.\n# TYPE crawler_skipped_pages_total counter\n";
+    out << "crawler_skipped_pages_total " << skippedPages << "\n";
+    out << "# HELP crawler_truncated_pages_total Responses not read to the end (size limit or skipped).\n# TYPE crawler_truncated_pages_total counter\n";
+    out << "crawler_truncated_pages_total " << truncatedPages << "\n";
+    out << "# TYPE crawler_connections_opened_total counter\ncrawler_connections_opened_total " << connectionsOpened << "\n";
+    out << "# TYPE crawler_open_connections gauge\ncrawler_open_connections " << openConnections << "\n";
+    for (auto &gauge : gauges) {
+        out << "# HELP crawler_" << gauge.name << " " << gauge.help << "\n# TYPE crawler_" << gauge.name << " gauge\n";
+        out << "crawler_" << gauge.name << " " << gauge.value << "\n";
+    }
+    return out.str();
+}
+
+//---------------------------------------------------------------------------
+// Write the metrics to a file (replaced at once, readers never see half of it)
+// or send them to a listening unix socket. Return Error Description or "".
+//---------------------------------------------------------------------------
+string Metrics::dump(const string &target, const string &format, const vector<Gauge> &gauges) {
+    lock_guard<mutex> lock(dumpMutex);
+    string text = render(format, gauges);
+
+    if (target.compare(0, 5, "unix:") == 0) {
+        struct sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        strncpy(address.sun_path, target.c_str() + 5, sizeof(address.sun_path) - 1);
+        int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (sock == -1) return "Cannot create socket!";
+        if (connect(sock, (struct sockaddr *)&address, sizeof(address)) == -1) {
+            close(sock);
+            return "Cannot connect to " + target + "!";
+        }
+        size_t sent = 0;
+        while (sent < text.size()) {
+            ssize_t n = send(sock, text.data() + sent, text.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0) break;
+            sent += n;
+        }
+        close(sock);
+        return sent == text.size() ? "" : "Cannot send to " + target + "!";
+    }
+
+    string tempPath = target + ".tmp";
+    ofstream file(tempPath, ios::trunc);
+    file << text;
+    file.close();
+    if (!file) return "Cannot write " + tempPath + "!";
+    if (rename(tempPath.c_str(), target.c_str()) != 0) return "Cannot rename " + tempPath + "!";
+    return "";
+}
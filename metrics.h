@@ -0,0 +1,134 @@
+//---------------------------------------------------------------------------
+// Header File for fetch metrics: phase histograms, counters & the periodic dump.
+//---------------------------------------------------------------------------
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <cstdint>
+
+using namespace std;
+
+// Phases of a fetch, timed in microseconds
+enum FetchPhase { PHASE_DNS, PHASE_CONNECT, PHASE_TTFB, PHASE_TRANSFER, PHASE_PARSE, NUM_PHASES };
+
+// Why a page failed
+enum FailureCause { FAIL_DNS, FAIL_CONNECT, FAIL_SEND, FAIL_RECV, FAIL_TIMEOUT, FAIL_PARSE, FAIL_STATUS, NUM_FAILURE_CAUSES };
+
+extern const char *PHASE_NAMES[NUM_PHASES];
+extern const char *FAILURE_NAMES[NUM_FAILURE_CAUSES];
+
+// Histogram with buckets growing by powers of two, each split in 8 linear
+// sub-buckets: ~12% precision from 1us to hours in a few hundred counters.
+// With atomic counters, threads record into it without any lock.
+template<typename Count, typename Total>
+class LogHistogram {
+    public:
+        static const int SUB_BITS = 3;
+        static const int MAX_EXPONENT = 35;
+        static const int NUM_BUCKETS = (MAX_EXPONENT - SUB_BITS + 1) << SUB_BITS;
+
+        LogHistogram() {
+            for (auto &bucket : buckets) bucket = 0;
+            total = 0;
+            sum = 0;
+            maxValue = 0;
+        }
+
+        void record(uint64_t value) {
+            buckets[bucketOf(value)] += 1;
+            total += 1;
+            sum += value;
+            raise(maxValue, value);
+        }
+
+        uint64_t count() const { return total; }
+        uint64_t valueSum() const { return sum; }
+        uint64_t maximum() const { return maxValue; }
+
+        // Value below which p percent of the values are, middle of its bucket (at most the max).
+        double percentile(double p) const {
+            uint64_t numValues = total;
+            if (numValues == 0) return 0;
+            uint64_t rank = uint64_t(p / 100 * numValues), seen = 0;
+            for (int i = 0; i < NUM_BUCKETS; i++) {
+                seen += buckets[i];
+                if (seen > rank) return min((double(lowerBound(i)) + double(lowerBound(i + 1))) / 2, double(maxValue));
+            }
+            return double(maxValue);
+        }
+
+    private:
+        Count buckets[NUM_BUCKETS];
+        Total total, sum, maxValue;
+
+        static int bucketOf(uint64_t value) {
+            if (value < (1u << SUB_BITS)) return int(value);
+            int exponent = 63 - __builtin_clzll(value);
+            if (exponent > MAX_EXPONENT) return NUM_BUCKETS - 1;
+            int sub = int((value >> (exponent - SUB_BITS)) & ((1u << SUB_BITS) - 1));
+            return ((exponent - SUB_BITS + 1) << SUB_BITS) + sub;
+        }
+
+        static uint64_t lowerBound(int index) {
+            if (index < (1 << SUB_BITS)) return uint64_t(index);
+            int exponent = (index >> SUB_BITS) + SUB_BITS - 1, sub = index & ((1 << SUB_BITS) - 1);
+            return uint64_t((1 << SUB_BITS) + sub) << (exponent - SUB_BITS);
+        }
+
+        static void raise(uint64_t &current, uint64_t value) {
+            if (value > current) current = value;
+        }
+
+        static void raise(atomic<uint64_t> &current, uint64_t value) {
+            uint64_t seen = current.load(memory_order_relaxed);
+            while (value > seen && !current.compare_exchange_weak(seen, value, memory_order_relaxed));
+        }
+};
+
+// Shared by the event loops / owned by one socket
+typedef LogHistogram< atomic<uint64_t>, atomic<uint64_t> > SharedHistogram;
+typedef LogHistogram<uint32_t, uint64_t> HostHistogram;
+
+// Values sampled at dump time, e.g. the frontier size
+typedef struct {
+    string name;
+    string help;
+    double value;
+} Gauge;
+
+// Process-wide fetch metrics. Sockets record into it from any loop thread; the
+// main thread renders it as Prometheus text or JSON & writes it to a file or a
+// unix socket ("unix:/path").
+class Metrics {
+    public:
+        static Metrics &instance();
+        void recordPhase(FetchPhase phase, uint64_t micros);
+        void countFailure(FailureCause cause);
+        void countResponse(int statusCode);
+        void addBytesSent(uint64_t bytes);
+        void addBytesReceived(uint64_t bytes);
+        void countRequests(uint64_t requests);
+        void countRetries(uint64_t pages);
+        void countConnection(int delta);
+        void countRedirect();
+        void countSkipped();
+        void countTruncated();
+        string render(const string &format, const vector<Gauge> &gauges);
+        string dump(const string &target, const string &format, const vector<Gauge> &gauges);
+    private:
+        Metrics();
+        SharedHistogram phases[NUM_PHASES];
+        atomic<uint64_t> failures[NUM_FAILURE_CAUSES];
+        atomic<uint64_t> responsesByClass[6];           // 1xx..5xx, others in [0]
+        atomic<uint64_t> bytesSent, bytesReceived, requests, retries, connectionsOpened;
+        atomic<uint64_t> redirects, skippedPages, truncatedPages;
+        atomic<int64_t> openConnections;
+        mutex dumpMutex;
+};
+
+#endif
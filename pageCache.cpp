@@ -0,0 +1,274 @@
+//---------------------------------------------------------------------------
+// C++ Implementation file for the page cache, metadata of the pages fetched by previous crawls.
+// A record is a u64 length, the body & its fingerprint; the body is the URL
+// fingerprint, ETag, Last-Modified, content hash & links (see serialize.h).
+// A torn record at the end (crash while writing) is cut off when the log is opened.
+//---------------------------------------------------------------------------
+
+#include "pageCache.h"
+#include "serialize.h"
+#include "urlDedup.h"
+#include <algorithm>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+static const char MAGIC[] = "PAGECAC1";
+static const size_t MAGIC_SIZE = sizeof(MAGIC) - 1;
+
+// New records are written in batches of this size.
+static const size_t WRITE_BATCH = 1 << 20;
+
+//---------------------------------------------------------------------------
+// FNV-1a over the decoded body, fed piece by piece; start from EMPTY_HASH.
+//---------------------------------------------------------------------------
+uint64_t updateContentHash(uint64_t hash, string_view data) {
+    for (unsigned char c : data) {
+        hash ^= c;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+PageCache &PageCache::instance() {
+    static PageCache cache;
+    return cache;
+}
+
+PageCache::PageCache() {
+    fd = -1;
+    mapped = NULL;
+    mappedSize = fileSize = 0;
+    hits = notModified = unchanged = stored = 0;
+    loadedPages = 0;
+}
+
+PageCache::~PageCache() {
+    close();
+}
+
+//---------------------------------------------------------------------------
+// Open the log (created if missing) & index the records of the previous crawls.
+// Return an error message, empty on success.
+//---------------------------------------------------------------------------
+string PageCache::open(const string &path) {
+    this->path = path;
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (fd == -1) return "Cannot open " + path + "!";
+    struct stat info;
+    if (fstat(fd, &info) != 0) return "Cannot read " + path + "!";
+
+    if (info.st_size == 0) {
+        if (write(fd, MAGIC, MAGIC_SIZE) != ssize_t(MAGIC_SIZE)) return "Cannot write " + path + "!";
+        fileSize = MAGIC_SIZE;
+        return "";
+    }
+    mappedSize = info.st_size;
+    void *data = mmap(NULL, mappedSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        mappedSize = 0;
+        return "Cannot map " + path + "!";
+    }
+    mapped = (const char *)data;
+    if (mappedSize < MAGIC_SIZE || string_view(mapped, MAGIC_SIZE) != string_view(MAGIC, MAGIC_SIZE)) {
+        return path + " is not a page cache file!";
+    }
+    return loadIndex();
+}
+
+//---------------------------------------------------------------------------
+// One pass over the records; the last record of a URL wins.
+//---------------------------------------------------------------------------
+string PageCache::loadIndex() {
+    uint64_t offset = MAGIC_SIZE;
+    string_view record;
+    while (recordAt(mapped, mappedSize, offset, record)) {
+        string_view body = record;
+        uint64_t key;
+        readU64(body, key);
+        index.push_back(IndexEntry{key, offset});
+        offset += record.size() + 2 * sizeof(uint64_t);
+    }
+    if (offset < mappedSize) {
+        // Torn tail, the mapped bytes after it are never read.
+        if (ftruncate(fd, offset) != 0) return "Cannot truncate " + path + "!";
+        mappedSize = offset;
+    }
+    fileSize = offset;
+
+    stable_sort(index.begin(), index.end(), [](const IndexEntry &a, const IndexEntry &b) { return a.key < b.key; });
+    size_t kept = 0;
+    for (size_t i = 0; i < index.size(); i++) {
+        if (i + 1 < index.size() && index[i + 1].key == index[i].key) continue;
+        index[kept++] = index[i];
+    }
+    index.resize(kept);
+    loadedPages = kept;
+    return "";
+}
+
+//---------------------------------------------------------------------------
+// The record body at offset, if it is complete & its fingerprint matches.
+//---------------------------------------------------------------------------
+bool PageCache::recordAt(const char *data, size_t size, uint64_t offset, string_view &record) {
+    if (offset > size) return false;
+    string_view in(data + offset, size - offset);
+    uint64_t length, check;
+    if (!readU64(in, length) || in.size() < length) return false;
+    string_view body = in.substr(0, length);
+    in.remove_prefix(length);
+    if (!readU64(in, check) || check != fingerprint(body)) return false;
+    record = body;
+    return true;
+}
+
+bool PageCache::decodeRecord(string_view record, CachedPage &page) {
+    uint64_t key, numLinks;
+    if (!readU64(record, key) || !readString(record, page.etag) || !readString(record, page.lastModified)) return false;
+    if (!readU64(record, page.contentHash) || !readU64(record, numLinks) || numLinks > record.size()) return false;
+    page.links.resize(numLinks);
+    for (auto &link : page.links) {
+        if (!readString(record, link.first) || !readString(record, link.second)) return false;
+    }
+    return true;
+}
+
+bool PageCache::isOpen() const {
+    return fd != -1;
+}
+
+//---------------------------------------------------------------------------
+// Metadata of the URL from a previous crawl. Lock free, only the mapped log is read.
+//---------------------------------------------------------------------------
+bool PageCache::lookup(const string &url, CachedPage &page) {
+    if (index.empty()) return false;
+    uint64_t key = fingerprint(url);
+    auto it = lower_bound(index.begin(), index.end(), key, [](const IndexEntry &entry, uint64_t key) { return entry.key < key; });
+    string_view record;
+    if (it == index.end() || it->key != key || !recordAt(mapped, mappedSize, it->offset, record)) return false;
+    if (!decodeRecord(record, page)) return false;
+    hits++;
+    return true;
+}
+
+//---------------------------------------------------------------------------
+// Append the metadata of a page fetched by this crawl; used by the next crawl.
+//---------------------------------------------------------------------------
+void PageCache::store(const string &url, const CachedPage &page) {
+    if (fd == -1) return;
+    string body;
+    appendU64(body, fingerprint(url));
+    appendString(body, page.etag);
+    appendString(body, page.lastModified);
+    appendU64(body, page.contentHash);
+    appendU64(body, page.links.size());
+    for (auto &link : page.links) {
+        appendString(body, link.first);
+        appendString(body, link.second);
+    }
+
+    lock_guard<mutex> lock(writeMutex);
+    added.push_back(IndexEntry{fingerprint(url), fileSize});
+    appendU64(writeBuffer, body.size());
+    writeBuffer += body;
+    appendU64(writeBuffer, fingerprint(body));
+    fileSize += body.size() + 2 * sizeof(uint64_t);
+    stored++;
+    if (writeBuffer.size() >= WRITE_BATCH) flushLocked();
+}
+
+string PageCache::flushLocked() {
+    size_t written = 0;
+    while (written < writeBuffer.size()) {
+        ssize_t n = write(fd, writeBuffer.data() + written, writeBuffer.size() - written);
+        if (n <= 0) {
+            writeBuffer.clear();
+            return "Cannot write " + path + "!";
+        }
+        written += n;
+    }
+    writeBuffer.clear();
+    return "";
+}
+
+//---------------------------------------------------------------------------
+// Rewrite the log with the newest record of each URL, once old ones are most of it.
+//---------------------------------------------------------------------------
+string PageCache::compact() {
+    void *data = mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) return "Cannot map " + path + "!";
+    const char *log = (const char *)data;
+
+    // Records of this crawl come after the loaded ones, the last one of a key wins.
+    vector<IndexEntry> live(index);
+    live.insert(live.end(), added.begin(), added.end());
+    stable_sort(live.begin(), live.end(), [](const IndexEntry &a, const IndexEntry &b) { return a.key < b.key; });
+    uint64_t liveBytes = MAGIC_SIZE;
+    vector<string_view> records;
+    string_view record;
+    for (size_t i = 0; i < live.size(); i++) {
+        if (i + 1 < live.size() && live[i + 1].key == live[i].key) continue;
+        if (!recordAt(log, fileSize, live[i].offset, record)) continue;
+        records.push_back(record);
+        liveBytes += record.size() + 2 * sizeof(uint64_t);
+    }
+
+    string error;
+    if (fileSize > 2 * liveBytes) {
+        string tempPath = path + ".tmp";
+        FILE *file = fopen(tempPath.c_str(), "wb");
+        if (!file) error = "Cannot create " + tempPath + "!";
+        if (file) {
+            string header;
+            fwrite(MAGIC, 1, MAGIC_SIZE, file);
+            for (auto &body : records) {
+                header.clear();
+                appendU64(header, body.size());
+                fwrite(header.data(), 1, header.size(), file);
+                fwrite(body.data(), 1, body.size(), file);
+                header.clear();
+                appendU64(header, fingerprint(body));
+                fwrite(header.data(), 1, header.size(), file);
+            }
+            if (fclose(file) != 0) error = "Cannot write " + tempPath + "!";
+                else if (rename(tempPath.c_str(), path.c_str()) != 0) error = "Cannot rename " + tempPath + "!";
+        }
+    }
+    munmap(data, fileSize);
+    return error;
+}
+
+//---------------------------------------------------------------------------
+// Write the pending records & compact the log. Return an error message, empty on success.
+//---------------------------------------------------------------------------
+string PageCache::close() {
+    if (fd == -1) return "";
+    lock_guard<mutex> lock(writeMutex);
+    string error = flushLocked();
+    if (error.empty() && !added.empty()) error = compact();
+    if (mapped) munmap((void *)mapped, mappedSize);
+    ::close(fd);
+    fd = -1;
+    mapped = NULL;
+    mappedSize = 0;
+    index.clear();
+    added.clear();
+    return error;
+}
+
+void PageCache::countNotModified() { notModified++; }
+void PageCache::countUnchanged() { unchanged++; }
+
+PageCacheStats PageCache::getStats() const {
+    PageCacheStats stats;
+    stats.loadedPages = loadedPages;
+    stats.hits = hits;
+    stats.notModified = notModified;
+    stats.unchanged = unchanged;
+    stats.stored = stored;
+    return stats;
+}
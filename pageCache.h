@@ -0,0 +1,77 @@
+//---------------------------------------------------------------------------
+// Header File for the page cache, metadata of the pages fetched by previous crawls.
+//---------------------------------------------------------------------------
+
+#ifndef PAGECACHE_H
+#define PAGECACHE_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+using namespace std;
+
+// What a recrawl needs to know about a page.
+typedef struct {
+    string etag;                                        // ETag header, as sent
+    string lastModified;                                // Last-Modified header, as sent
+    uint64_t contentHash = 0;                           // hash of the decoded body
+    vector< pair<string, string> > links;               // extracted (host, path), host empty for the same host
+} CachedPage;
+
+typedef struct {
+    uint64_t loadedPages = 0;                           // pages in the cache at startup
+    uint64_t hits = 0;                                  // lookups answered
+    uint64_t notModified = 0;                           // 304 answers, cached links reused
+    uint64_t unchanged = 0;                             // full answers with the same content
+    uint64_t stored = 0;                                // records added by this crawl
+} PageCacheStats;
+
+uint64_t updateContentHash(uint64_t hash, string_view data);
+
+// Log of records keyed by the URL fingerprint. The file of the previous crawls is
+// mapped read-only & indexed by one pass at startup; new records are appended,
+// and the log is rewritten without the old versions when they make most of it.
+class PageCache {
+    public:
+        static const uint64_t EMPTY_HASH = 0xcbf29ce484222325ULL;
+        static PageCache &instance();
+        string open(const string &path);
+        string close();
+        bool isOpen() const;
+        bool lookup(const string &url, CachedPage &page);
+        void store(const string &url, const CachedPage &page);
+        void countNotModified();
+        void countUnchanged();
+        PageCacheStats getStats() const;
+    private:
+        typedef struct {
+            uint64_t key;
+            uint64_t offset;                            // of the record in the file
+        } IndexEntry;
+
+        PageCache();
+        ~PageCache();
+        string path;
+        int fd;
+        const char *mapped;                             // the log as it was at startup
+        size_t mappedSize;
+        vector<IndexEntry> index;                       // sorted by key, read only during the crawl
+        mutex writeMutex;
+        string writeBuffer;
+        uint64_t fileSize;                              // including the write buffer
+        vector<IndexEntry> added;                       // records appended by this crawl
+        atomic<uint64_t> hits, notModified, unchanged, stored;
+        uint64_t loadedPages;
+        string loadIndex();
+        string flushLocked();
+        string compact();
+        static bool decodeRecord(string_view record, CachedPage &page);
+        static bool recordAt(const char *data, size_t size, uint64_t offset, string_view &record);
+};
+
+#endif
@@ -6,18 +6,15 @@
 #define PARSER_H
 
 #include <string>
+#include <string_view>
 #include <vector>
 
 using namespace std;
 
-string getHostnameFromUrl(string url);
-string getHostPathFromUrl(string url);
+// The returned parts are views into the given URL (or a static "/").
+string_view getHostnameFromUrl(string_view url);
+void splitUrl(string_view url, string_view &hostname, string_view &path);
 
-vector< pair<string, string> > extractUrls(string httpRaw);
-bool verifyUrl(string url);
-bool verifyDomain(string url);
-bool verifyType(string url);
-bool hasSuffix(string str, string suffix);
-string reformatHttpResponse(string text);
+vector< pair<string, string> > extractUrls(string_view httpRaw);
 
 #endif
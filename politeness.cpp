@@ -0,0 +1,126 @@
+//---------------------------------------------------------------------------
+// C++ Implementation file for the politeness scheduler, the per-host delays between requests.
+//---------------------------------------------------------------------------
+
+#include "politeness.h"
+#include <algorithm>
+
+using namespace std;
+using namespace std::chrono;
+
+//---------------------------------------------------------------------------
+// PolitenessScheduler constructor. Delays are in milliseconds; hostDelays overrides
+// defaultDelay for specific hosts.
+//---------------------------------------------------------------------------
+PolitenessScheduler::PolitenessScheduler(EventLoop *loop, int defaultDelay, const map<string, int> *hostDelays) {
+    this->loop = loop;
+    this->defaultDelay = defaultDelay;
+    this->hostDelays = hostDelays;
+    this->slots.resize(NUM_SLOTS);
+    this->startTime = steady_clock::now();
+    this->currentTick = 0;
+    this->count = 0;
+    this->ticking = false;
+}
+
+int PolitenessScheduler::delayFor(const string &hostname) const {
+    if (hostDelays != NULL) {
+        auto it = hostDelays->find(hostname);
+        if (it != hostDelays->end()) return it->second;
+    }
+    return defaultDelay;
+}
+
+//---------------------------------------------------------------------------
+// Call onReady once delay ms, counted from now, are over.
+//---------------------------------------------------------------------------
+void PolitenessScheduler::schedule(int delay, function<void()> onReady) {
+    if (delay <= 0) {
+        loop->post(onReady);
+        return;
+    }
+
+    // Idle wheel: nothing to catch up on
+    if (!ticking) currentTick = nowTick();
+
+    Entry entry;
+    entry.dueTick = nowTick() + (delay + TICK_MS - 1) / TICK_MS;
+    entry.onReady = onReady;
+    slots[entry.dueTick % NUM_SLOTS].push_back(entry);
+    count++;
+
+    if (!ticking) {
+        ticking = true;
+        loop->runAfter(milliseconds(TICK_MS), [this] { tick(); });
+    }
+}
+
+size_t PolitenessScheduler::size() const {
+    return count;
+}
+
+uint64_t PolitenessScheduler::nowTick() const {
+    return duration_cast<milliseconds>(steady_clock::now() - startTime).count() / TICK_MS;
+}
+
+//---------------------------------------------------------------------------
+// Advance the wheel to the current time & hand out the hosts that are due.
+//---------------------------------------------------------------------------
+void PolitenessScheduler::tick() {
+    vector< function<void()> > ready;
+    uint64_t target = nowTick();
+    for (; currentTick <= target; currentTick++) {
+        vector<Entry> &slot = slots[currentTick % NUM_SLOTS];
+        for (size_t i = 0; i < slot.size(); ) {
+            if (slot[i].dueTick <= currentTick) {
+                ready.push_back(slot[i].onReady);
+                slot[i] = slot.back();
+                slot.pop_back();
+            } else {
+                i++;
+            }
+        }
+    }
+    currentTick = target;
+    count -= ready.size();
+
+    ticking = count > 0;
+    if (ticking) loop->runAfter(milliseconds(TICK_MS), [this] { tick(); });
+    for (auto &onReady : ready) onReady();
+}
+
+//---------------------------------------------------------------------------
+// TokenBucket constructor. The bucket starts full, so the first requests go out at once.
+//---------------------------------------------------------------------------
+TokenBucket::TokenBucket(int delay, int burst) {
+    this->delay = delay;
+    this->burst = max(burst, 1);
+    this->tokens = this->burst;
+    this->lastRefill = steady_clock::now();
+}
+
+//---------------------------------------------------------------------------
+// Use a token if there is one.
+//---------------------------------------------------------------------------
+bool TokenBucket::take() {
+    if (delay <= 0) return true;
+    refill();
+    if (tokens < 1) return false;
+    tokens -= 1;
+    return true;
+}
+
+//---------------------------------------------------------------------------
+// Time (ms) until the next token.
+//---------------------------------------------------------------------------
+int TokenBucket::waitTime() {
+    if (delay <= 0) return 0;
+    refill();
+    return tokens >= 1 ? 0 : int((1 - tokens) * delay) + 1;
+}
+
+void TokenBucket::refill() {
+    steady_clock::time_point now = steady_clock::now();
+    tokens = min(burst, tokens + duration<double, milli>(now - lastRefill).count() / delay);
+    lastRefill = now;
+}
@@ -0,0 +1,62 @@
+//---------------------------------------------------------------------------
+// Header File for the politeness scheduler, the per-host delays between requests.
+//---------------------------------------------------------------------------
+
+#ifndef POLITENESS_H
+#define POLITENESS_H
+
+#include "eventLoop.h"
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <functional>
+#include <cstdint>
+
+using namespace std;
+
+// Timing wheel of hosts waiting for their next allowed fetch, one per event loop.
+// A host is handed back (onReady) once its delay is over, so a loop can serve
+// many hosts while each of them waits.
+class PolitenessScheduler {
+    public:
+        PolitenessScheduler(EventLoop *loop, int defaultDelay, const map<string, int> *hostDelays);
+        int delayFor(const string &hostname) const;
+        void schedule(int delay, function<void()> onReady);
+        size_t size() const;
+    private:
+        typedef struct {
+            uint64_t dueTick;
+            function<void()> onReady;
+        } Entry;
+
+        static constexpr int TICK_MS = 5;                 // resolution of the wheel
+        static constexpr size_t NUM_SLOTS = 1024;         // slots, longer delays take several turns
+
+        EventLoop *loop;
+        int defaultDelay;
+        const map<string, int> *hostDelays;
+        vector< vector<Entry> > slots;
+        uint64_t currentTick;
+        chrono::steady_clock::time_point startTime;
+        size_t count;
+        bool ticking;
+        uint64_t nowTick() const;
+        void tick();
+};
+
+// Requests allowed to one host: a token every delay ms, at most burst of them
+// saved while the host is idle. Used by the loop thread of the host only.
+class TokenBucket {
+    public:
+        TokenBucket(int delay, int burst);
+        bool take();
+        int waitTime();
+    private:
+        double delay;                                   // ms per token, <= 0 for no limit
+        double burst, tokens;
+        chrono::steady_clock::time_point lastRefill;
+        void refill();
+};
+
+#endif
@@ -0,0 +1,157 @@
+//---------------------------------------------------------------------------
+// C++ Implementation file for the corpus replay, the CPU side of a crawl at full speed.
+//---------------------------------------------------------------------------
+
+#include "replay.h"
+#include "httpParser.h"
+#include "contentDecoder.h"
+#include "linkExtractor.h"
+#include "shardedSet.h"
+#include "parser.h"
+#include <thread>
+#include <memory>
+#include <unordered_map>
+#include <algorithm>
+#include <chrono>
+
+using namespace std;
+using namespace std::chrono;
+
+const char *REPLAY_STAGE_NAMES[NUM_REPLAY_STAGES] = {"http", "extract", "dedup"};
+
+// Pages & linked sites seen on a host, as a ClientSocket keeps them
+typedef pair< unique_ptr<UrlDedup>, unique_ptr<UrlDedup> > HostSets;
+
+static uint64_t nanosSince(steady_clock::time_point &start) {
+    steady_clock::time_point now = steady_clock::now();
+    uint64_t nanos = duration_cast<nanoseconds>(now - start).count();
+    start = now;
+    return nanos;
+}
+
+//---------------------------------------------------------------------------
+// Replay thread: the responses of its hosts, one after the other.
+//---------------------------------------------------------------------------
+static void replayRecords(const vector<const CorpusRecord *> &records, const ReplayOptions &options, ShardedSet &sites, ReplayStats &stats) {
+    HttpResponseParser parser;
+    ContentDecoder decoder;
+    LinkExtractor extractor;
+    unordered_map<string, HostSets> hosts;
+    string body;
+    bool extractBody = false;
+    parser.setMaxBodySize(options.maxBodySize);
+    decoder.setMaxDecodedSize(options.maxDecodedSize);
+    parser.setBodyHandler([&](string_view data) {
+        if (!extractBody) return;
+        if (!decoder.isActive()) body.append(data.data(), data.size());
+            else if (!decoder.feed(data, [&body](string_view decoded) { body.append(decoded.data(), decoded.size()); })) parser.skipBody();
+    });
+
+    for (auto record : records) {
+        string_view hostname, path;
+        splitUrl(record->uri, hostname, path);
+        stats.responses++;
+        stats.bytes += record->response.size();
+
+        // HTTP framing, de-chunking & inflation; only successful HTML pages are kept, as in a crawl
+        steady_clock::time_point start = steady_clock::now();
+        parser.reset();
+        decoder.end();
+        body.clear();
+        extractBody = false;
+        bool headersChecked = false;
+        string_view data = record->response;
+        while (!parser.hasError() && !parser.isComplete()) {
+            size_t used = parser.feed(data);
+            data.remove_prefix(used);
+            if (parser.hasHeaders() && !headersChecked) {
+                headersChecked = true;
+                int status = parser.getStatusCode();
+                string type = parser.getContentType();
+                extractBody = status >= 200 && status < 300 && (type.empty() || type.find("html") != string::npos);
+                string encoding = parser.getHeader("content-encoding");
+                transform(encoding.begin(), encoding.end(), encoding.begin(), ::tolower);
+                if (extractBody && encoding != "" && encoding != "identity" && !decoder.start(encoding)) extractBody = false;
+                if (!extractBody) parser.skipBody();
+                continue;
+            }
+            if (used == 0 || data.empty()) break;
+        }
+        if (!parser.hasError() && !parser.isComplete()) parser.finishOnClose();
+        bool page = extractBody && !parser.hasError() && !decoder.hasError();
+        stats.stages[STAGE_HTTP].nanos += nanosSince(start);
+        stats.stages[STAGE_HTTP].bytes += record->response.size();
+        if (!page) continue;
+        stats.pages++;
+        stats.stages[STAGE_HTTP].items++;
+
+        // Links of the page, through the URL filter
+        extractor.reset();
+        extractor.feed(body);
+        extractor.finish();
+        const vector< pair<string_view, string_view> > &urls = extractor.getUrls();
+        stats.links += urls.size();
+        stats.stages[STAGE_EXTRACT].nanos += nanosSince(start);
+        stats.stages[STAGE_EXTRACT].bytes += body.size();
+        stats.stages[STAGE_EXTRACT].items += urls.size();
+
+        // Pages new to their host, linked sites new to the host & then to the crawl
+        HostSets &sets = hosts[string(hostname)];
+        if (!sets.first) {
+            sets.first.reset(new UrlDedup(options.dedup));
+            sets.second.reset(new UrlDedup(options.dedup));
+        }
+        for (auto &url : urls) {
+            if (url.first == "" || url.first == hostname) {
+                if (sets.first->insert(url.second)) stats.newPages++;
+            } else if (sets.second->insert(url.first) && sites.insert(string(url.first))) {
+                stats.newSites++;
+            }
+        }
+        stats.stages[STAGE_DEDUP].nanos += nanosSince(start);
+        stats.stages[STAGE_DEDUP].items += urls.size();
+    }
+}
+
+static void addStats(ReplayStats &total, const ReplayStats &stats) {
+    total.responses += stats.responses;
+    total.bytes += stats.bytes;
+    total.pages += stats.pages;
+    total.links += stats.links;
+    total.newPages += stats.newPages;
+    total.newSites += stats.newSites;
+    for (int i = 0; i < NUM_REPLAY_STAGES; i++) {
+        total.stages[i].nanos += stats.stages[i].nanos;
+        total.stages[i].bytes += stats.stages[i].bytes;
+        total.stages[i].items += stats.stages[i].items;
+    }
+}
+
+//---------------------------------------------------------------------------
+// Replay the records options.passes times on options.threads threads.
+//---------------------------------------------------------------------------
+ReplayStats replayCorpus(const vector<CorpusRecord> &records, const ReplayOptions &options) {
+    int threads = max(options.threads, 1);
+    vector< vector<const CorpusRecord *> > parts(threads);
+    for (auto &record : records) {
+        string_view hostname, path;
+        splitUrl(record.uri, hostname, path);
+        parts[fingerprint(hostname) % threads].push_back(&record);
+    }
+    DedupOptions siteDedup = options.dedup;
+    siteDedup.initialCapacity = 4096;
+
+    ReplayStats total;
+    steady_clock::time_point start = steady_clock::now();
+    for (int pass = 0; pass < max(options.passes, 1); pass++) {
+        ShardedSet sites;
+        sites.configure(siteDedup);
+        vector<ReplayStats> results(threads);
+        vector<thread> workers;
+        for (int i = 0; i < threads; i++) workers.push_back(thread(replayRecords, cref(parts[i]), cref(options), ref(sites), ref(results[i])));
+        for (auto &worker : workers) worker.join();
+        for (auto &result : results) addStats(total, result);
+    }
+    total.seconds = duration<double>(steady_clock::now() - start).count();
+    return total;
+}
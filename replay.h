@@ -0,0 +1,52 @@
+//---------------------------------------------------------------------------
+// Header File for the corpus replay: recorded responses pushed through the
+// parse, extract/filter & dedup stages of a crawl, with no network.
+//---------------------------------------------------------------------------
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "corpus.h"
+#include "urlDedup.h"
+#include <string>
+#include <vector>
+#include <cstdint>
+
+using namespace std;
+
+// Stages of a replayed response
+enum ReplayStage { STAGE_HTTP, STAGE_EXTRACT, STAGE_DEDUP, NUM_REPLAY_STAGES };
+
+extern const char *REPLAY_STAGE_NAMES[NUM_REPLAY_STAGES];
+
+typedef struct {
+    int threads = 1;
+    int passes = 1;                                     // times the corpus is replayed, each from empty sets
+    size_t maxBodySize = 0;                             // as in FetchOptions
+    size_t maxDecodedSize = 0;
+    DedupOptions dedup;
+} ReplayOptions;
+
+// Work of a stage, summed over the threads
+typedef struct {
+    uint64_t nanos = 0;
+    uint64_t bytes = 0;                                 // fed to the stage
+    uint64_t items = 0;                                 // http: pages, extract: links out, dedup: links in
+} StageStats;
+
+typedef struct {
+    uint64_t responses = 0;
+    uint64_t bytes = 0;                                 // of the responses
+    uint64_t pages = 0;                                 // HTML pages read
+    uint64_t links = 0;                                 // links kept by the filter
+    uint64_t newPages = 0;                              // links to pages not seen on their host yet
+    uint64_t newSites = 0;                              // links to sites not seen by any host yet
+    double seconds = 0;                                 // wall time of all the passes
+    StageStats stages[NUM_REPLAY_STAGES];
+} ReplayStats;
+
+// Responses of a host all go to the same thread, as they go to one event loop
+// in a crawl; the set of linked sites is shared by all the threads.
+ReplayStats replayCorpus(const vector<CorpusRecord> &records, const ReplayOptions &options);
+
+#endif
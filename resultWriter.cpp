@@ -0,0 +1,334 @@
+//---------------------------------------------------------------------------
+// C++ Implementation file for the result writer, site statistics written by a thread of its own.
+//---------------------------------------------------------------------------
+
+#include "resultWriter.h"
+#include "serialize.h"
+#include <sstream>
+#include <iomanip>
+#include <cstdio>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+// The buffer is written once it holds this much, or when the queue runs dry.
+static const size_t WRITE_SIZE = 1 << 20;
+
+//---------------------------------------------------------------------------
+// ResultWriter constructor. An empty path is stdout.
+//---------------------------------------------------------------------------
+ResultWriter::ResultWriter(const string &format, const string &path, size_t queueSize) {
+    this->format = format;
+    this->path = path;
+    this->queueSize = max(queueSize, size_t(1));
+    this->fd = -1;
+    this->resumeBytes = 0;
+    this->outputBytes = 0;
+    this->graph = NULL;
+    this->pushed = 0;
+    this->written = 0;
+    this->stopping = false;
+}
+
+ResultWriter::~ResultWriter() {
+    stop();
+}
+
+//---------------------------------------------------------------------------
+// Hand the formatted records to sink (whole records, no file header) instead of writing them.
+//---------------------------------------------------------------------------
+void ResultWriter::setSink(function<void(const string&)> sink) {
+    this->sink = sink;
+}
+
+//---------------------------------------------------------------------------
+// Add every site to graph too, on the writer thread. Set before start.
+//---------------------------------------------------------------------------
+void ResultWriter::setLinkGraph(LinkGraphBuilder *graph) {
+    this->graph = graph;
+}
+
+//---------------------------------------------------------------------------
+// Continue the output of a resumed crawl: its first outputBytes are kept, what was
+// written after the checkpoint is cut. Set before start.
+//---------------------------------------------------------------------------
+void ResultWriter::resumeAt(uint64_t outputBytes) {
+    this->resumeBytes = outputBytes;
+}
+
+//---------------------------------------------------------------------------
+// Open the output & start the writer thread. Return Error Description or "".
+//---------------------------------------------------------------------------
+string ResultWriter::start() {
+    if (format != "text" && format != "jsonl" && format != "binary") return "Unknown output format " + format + "!";
+    if (sink) {
+        writerThread = thread(&ResultWriter::run, this);
+        return "";
+    }
+    bool resuming = resumeBytes > 0 && path != "";
+    if (path == "") fd = STDOUT_FILENO;
+        else fd = open(path.c_str(), O_WRONLY | O_CREAT | (resuming ? 0 : O_TRUNC) | O_CLOEXEC, 0644);
+    if (fd == -1) return "Cannot open " + path + "!";
+    if (resuming) {
+        // Shorter than at the checkpoint: sites counted as written are missing
+        struct stat status;
+        if (fstat(fd, &status) != 0 || uint64_t(status.st_size) < resumeBytes) return "Cannot resume " + path + ", it is shorter than at the checkpoint!";
+        if (ftruncate(fd, resumeBytes) != 0 || lseek(fd, 0, SEEK_END) != off_t(resumeBytes)) return "Cannot resume " + path + "!";
+        outputBytes = resumeBytes;
+    } else if (format == "binary") {
+        buffer += "CRAWLRS1";
+    }
+    writerThread = thread(&ResultWriter::run, this);
+    return "";
+}
+
+//---------------------------------------------------------------------------
+// Queue a finished site. Waits only if the writer is queueSize sites behind.
+//---------------------------------------------------------------------------
+void ResultWriter::push(SiteResult &&result) {
+    unique_lock<mutex> lock(m_mutex);
+    while (queue.size() >= queueSize && !stopping) notFull.wait(lock);
+    queue.push_back(move(result));
+    pushed++;
+    notEmpty.notify_one();
+}
+
+//---------------------------------------------------------------------------
+// Wait until every site pushed so far is written out.
+//---------------------------------------------------------------------------
+void ResultWriter::flush() {
+    unique_lock<mutex> lock(m_mutex);
+    uint64_t target = pushed;
+    while (written < target && writerThread.joinable()) flushed.wait(lock);
+}
+
+//---------------------------------------------------------------------------
+// fsync the output file, for a checkpoint counting the sites flushed so far.
+// Return an error message, empty on success; also a write error of the writer thread.
+//---------------------------------------------------------------------------
+string ResultWriter::sync() {
+    {
+        lock_guard<mutex> lock(m_mutex);
+        if (!error.empty()) return error;
+    }
+    if (sink || fd == -1 || path == "") return "";
+    return fsync(fd) == 0 ? "" : "Cannot sync " + path + "!";
+}
+
+//---------------------------------------------------------------------------
+// Write what is left & stop the writer thread. Return the first write error,
+// empty if all the sites were written.
+//---------------------------------------------------------------------------
+string ResultWriter::stop() {
+    {
+        lock_guard<mutex> lock(m_mutex);
+        stopping = true;
+        notEmpty.notify_one();
+        notFull.notify_all();
+    }
+    if (writerThread.joinable()) writerThread.join();
+    if (fd != -1 && fd != STDOUT_FILENO && close(fd) != 0 && error.empty()) error = "Cannot close " + path + "!";
+    fd = -1;
+    return error;
+}
+
+//---------------------------------------------------------------------------
+// Bytes in the output, all of them once flush returned.
+//---------------------------------------------------------------------------
+uint64_t ResultWriter::getOutputBytes() const {
+    return outputBytes;
+}
+
+//---------------------------------------------------------------------------
+// Writer thread: take all the queued sites at once, format them outside the lock.
+//---------------------------------------------------------------------------
+void ResultWriter::run() {
+    deque<SiteResult> batch;
+    while (true) {
+        {
+            unique_lock<mutex> lock(m_mutex);
+            while (queue.empty() && !stopping) notEmpty.wait(lock);
+            if (queue.empty()) break;
+            batch.swap(queue);
+            notFull.notify_all();
+        }
+        for (auto &result : batch) {
+            formatResult(result);
+            if (graph) graph->addSite(result.stats, result.depth);
+            if (buffer.size() >= WRITE_SIZE) writeBuffer();
+        }
+        writeBuffer();
+
+        lock_guard<mutex> lock(m_mutex);
+        written += batch.size();
+        batch.clear();
+        flushed.notify_all();
+    }
+    writeBuffer();
+}
+
+void ResultWriter::writeBuffer() {
+    if (sink) {
+        if (!buffer.empty()) sink(buffer);
+        buffer.clear();
+        return;
+    }
+    {
+        lock_guard<mutex> lock(m_mutex);
+        if (!error.empty()) {
+            buffer.clear();
+            return;
+        }
+    }
+    size_t done = 0;
+    while (done < buffer.size()) {
+        ssize_t n = write(fd, buffer.data() + done, buffer.size() - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        done += n;
+    }
+    outputBytes += done;
+    if (done < buffer.size()) {
+        lock_guard<mutex> lock(m_mutex);
+        error = "Cannot write " + (path == "" ? string("the output") : path) + "!";
+    }
+    buffer.clear();
+}
+
+void ResultWriter::formatResult(const SiteResult &result) {
+    if (format == "jsonl") formatJson(result);
+    else if (format == "binary") formatBinary(result);
+    else formatText(result);
+}
+
+//---------------------------------------------------------------------------
+// The statistics of one website, as the crawler always printed them. Fields added
+// since (skipped pages, phase times...) are only in the jsonl & binary records.
+//---------------------------------------------------------------------------
+void ResultWriter::formatText(const SiteResult &result) {
+    const SiteStats &stats = result.stats;
+    ostringstream out;
+    out << "----------------------------------------------------------------------------" << "\n";
+    out << "Website: " << stats.hostname << "\n";
+    out << "Depth (distance from the starting pages): " << result.depth << "\n";
+    out << "Number of Pages Discovered: " << stats.discoveredPages.size() << "\n";
+    out << "Number of Pages Failed to Discover: " << stats.numberOfPagesFailed << "\n";
+    out << "Number of Linked Sites: " << stats.linkedSites.size() << "\n";
+    if (stats.minResponseTime < 0) out << "Min. Response Time: N.A" << "\n";
+        else out << "Min. Response Time: " << stats.minResponseTime << "ms" << "\n";
+    if (stats.maxResponseTime < 0) out << "Max. Response Time: N.A" << "\n";
+        else out << "Max. Response Time: " << stats.maxResponseTime << "ms" << "\n";
+    if (stats.averageResponseTime < 0) out << "Average Response Time: N.A" << "\n";
+        else out << "Average Response Time: " << stats.averageResponseTime << "ms" << "\n";
+    if (!stats.discoveredPages.empty()) {
+        out << "List of visited pages:" << "\n";
+        out << "    " << setw(15) << "Response Time" << "    " << "URL" << "\n";
+        for (auto &page : stats.discoveredPages) {
+            out << "    " << setw(13) << page.second << "ms" << "    " << stats.hostname << page.first << "\n";
+        }
+    }
+    buffer += out.str();
+}
+
+static void appendJsonString(string &out, string_view value) {
+    out += '"';
+    for (unsigned char c : value) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += char(c);
+        } else if (c < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out += escaped;
+        } else out += char(c);
+    }
+    out += '"';
+}
+
+static void appendJsonNumber(string &out, double value) {
+    char text[32];
+    snprintf(text, sizeof(text), "%.6g", value);
+    out += text;
+}
+
+//---------------------------------------------------------------------------
+// One line per website; times in ms, -1 when not known.
+//---------------------------------------------------------------------------
+void ResultWriter::formatJson(const SiteResult &result) {
+    const SiteStats &stats = result.stats;
+    buffer += "{\"host\":";
+    appendJsonString(buffer, stats.hostname);
+    buffer += ",\"depth\":" + to_string(result.depth);
+    buffer += ",\"pages_failed\":" + to_string(stats.numberOfPagesFailed);
+    buffer += ",\"pages_skipped\":" + to_string(stats.numberOfPagesSkipped);
+    buffer += ",\"redirects\":" + to_string(stats.numberOfRedirects);
+    buffer += ",\"pages_unchanged\":" + to_string(stats.numberOfPagesUnchanged);
+    buffer += ",\"bytes_compressed\":" + to_string(stats.bytesCompressed);
+    buffer += ",\"bytes_decompressed\":" + to_string(stats.bytesDecompressed);
+    buffer += ",\"min_ms\":";
+    appendJsonNumber(buffer, stats.minResponseTime);
+    buffer += ",\"max_ms\":";
+    appendJsonNumber(buffer, stats.maxResponseTime);
+    buffer += ",\"avg_ms\":";
+    appendJsonNumber(buffer, stats.averageResponseTime);
+    buffer += ",\"phases\":{";
+    for (int phase = 0; phase < NUM_PHASES; phase++) {
+        const HostHistogram &histogram = stats.phases[phase];
+        buffer += string(phase ? "," : "") + "\"" + PHASE_NAMES[phase] + "\":{\"count\":" + to_string(histogram.count()) + ",\"p50_ms\":";
+        appendJsonNumber(buffer, histogram.percentile(50) / 1000);
+        buffer += ",\"max_ms\":";
+        appendJsonNumber(buffer, histogram.maximum() / 1000.0);
+        buffer += "}";
+    }
+    buffer += "},\"pages\":[";
+    for (size_t i = 0; i < stats.discoveredPages.size(); i++) {
+        buffer += i ? ",{\"url\":" : "{\"url\":";
+        appendJsonString(buffer, string(stats.hostname).append(stats.discoveredPages[i].first));
+        buffer += ",\"ms\":";
+        appendJsonNumber(buffer, stats.discoveredPages[i].second);
+        buffer += "}";
+    }
+    buffer += "],\"linked_sites\":[";
+    for (size_t i = 0; i < stats.linkedSites.size(); i++) {
+        if (i) buffer += ",";
+        appendJsonString(buffer, stats.linkedSites[i]);
+    }
+    buffer += "]}\n";
+}
+
+//---------------------------------------------------------------------------
+// u64 size of the rest, hostname, depth, pages failed, skipped, redirects, unchanged, compressed &
+// decompressed bytes, min/max/avg ms, the p50 & max ms of each phase, pages (url, ms), linked sites. Strings are a u64
+// length & the bytes (see serialize.h), numbers are host order.
+//---------------------------------------------------------------------------
+void ResultWriter::formatBinary(const SiteResult &result) {
+    const SiteStats &stats = result.stats;
+    string record;
+    appendString(record, stats.hostname);
+    appendU64(record, uint64_t(result.depth));
+    appendU64(record, uint64_t(stats.numberOfPagesFailed));
+    appendU64(record, uint64_t(stats.numberOfPagesSkipped));
+    appendU64(record, uint64_t(stats.numberOfRedirects));
+    appendU64(record, uint64_t(stats.numberOfPagesUnchanged));
+    appendU64(record, stats.bytesCompressed);
+    appendU64(record, stats.bytesDecompressed);
+    appendDouble(record, stats.minResponseTime);
+    appendDouble(record, stats.maxResponseTime);
+    appendDouble(record, stats.averageResponseTime);
+    for (int phase = 0; phase < NUM_PHASES; phase++) {
+        appendDouble(record, stats.phases[phase].percentile(50) / 1000);
+        appendDouble(record, stats.phases[phase].maximum() / 1000.0);
+    }
+    appendU64(record, stats.discoveredPages.size());
+    for (auto &page : stats.discoveredPages) {
+        appendString(record, string(stats.hostname).append(page.first));
+        appendDouble(record, page.second);
+    }
+    appendU64(record, stats.linkedSites.size());
+    for (auto &site : stats.linkedSites) appendString(record, site);
+    appendU64(buffer, record.size());
+    buffer += record;
+}
@@ -0,0 +1,70 @@
+//---------------------------------------------------------------------------
+// Header File for the result writer, site statistics written by a thread of its own.
+//---------------------------------------------------------------------------
+
+#ifndef RESULTWRITER_H
+#define RESULTWRITER_H
+
+#include "clientSocket.h"
+#include "linkGraph.h"
+#include <string>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+
+using namespace std;
+
+typedef struct {
+    SiteStats stats;
+    int depth;                                          // distance from the starting sites
+} SiteResult;
+
+// Event loops push finished sites into a bounded queue; the writer thread takes
+// them in batches, formats them & writes large buffers. Formats:
+//   text   - the classic statistics, one block per site
+//   jsonl  - one JSON object per site & line
+//   binary - "CRAWLRS1", then per site: u64 record size & the fields (see writeBinary)
+class ResultWriter {
+    public:
+        ResultWriter(const string &format, const string &path, size_t queueSize);
+        ~ResultWriter();
+        void setSink(function<void(const string&)> sink);
+        void setLinkGraph(LinkGraphBuilder *graph);
+        void resumeAt(uint64_t outputBytes);
+        string start();
+        void push(SiteResult &&result);
+        void flush();
+        string sync();
+        string stop();
+        uint64_t getOutputBytes() const;
+    private:
+        string format, path;
+        function<void(const string&)> sink;             // takes the formatted records instead of the output
+        LinkGraphBuilder *graph;                        // also gets every site, NULL if none
+        size_t queueSize;
+        int fd;
+        uint64_t resumeBytes;                           // output kept from the resumed crawl, 0 for a new one
+        atomic<uint64_t> outputBytes;                   // written to the output so far
+        deque<SiteResult> queue;
+        uint64_t pushed, written;                       // sites, to know when a flush is done
+        string error;                                   // first write error, nothing is written after it
+        bool stopping;
+        mutex m_mutex;
+        condition_variable notEmpty, notFull, flushed;
+        thread writerThread;
+        string buffer;
+
+        void run();
+        void formatResult(const SiteResult &result);
+        void formatText(const SiteResult &result);
+        void formatJson(const SiteResult &result);
+        void formatBinary(const SiteResult &result);
+        void writeBuffer();
+};
+
+#endif
@@ -0,0 +1,71 @@
+//---------------------------------------------------------------------------
+// Header File for binary serialization helpers, used by checkpoints & on-disk files.
+//---------------------------------------------------------------------------
+
+#ifndef SERIALIZE_H
+#define SERIALIZE_H
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <cstring>
+
+using namespace std;
+
+// Fixed width little-endian (host order, files are not meant to move between machines).
+inline void appendU64(string &out, uint64_t value) {
+    out.append((const char *)&value, sizeof(value));
+}
+
+inline bool readU64(string_view &in, uint64_t &value) {
+    if (in.size() < sizeof(value)) return false;
+    memcpy(&value, in.data(), sizeof(value));
+    in.remove_prefix(sizeof(value));
+    return true;
+}
+
+inline void appendString(string &out, string_view value) {
+    appendU64(out, value.size());
+    out.append(value.data(), value.size());
+}
+
+inline bool readString(string_view &in, string &value) {
+    uint64_t length;
+    if (!readU64(in, length) || in.size() < length) return false;
+    value.assign(in.data(), length);
+    in.remove_prefix(length);
+    return true;
+}
+
+inline void appendDouble(string &out, double value) {
+    out.append((const char *)&value, sizeof(value));
+}
+
+inline bool readDouble(string_view &in, double &value) {
+    if (in.size() < sizeof(value)) return false;
+    memcpy(&value, in.data(), sizeof(value));
+    in.remove_prefix(sizeof(value));
+    return true;
+}
+
+// LEB128: 7 bits per byte, the high bit set on all but the last one.
+inline void appendVarint(string &out, uint64_t value) {
+    while (value >= 0x80) {
+        out += char(value | 0x80);
+        value >>= 7;
+    }
+    out += char(value);
+}
+
+inline bool readVarint(string_view &in, uint64_t &value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && !in.empty(); shift += 7) {
+        uint8_t byte = uint8_t(in[0]);
+        in.remove_prefix(1);
+        value |= uint64_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+#endif
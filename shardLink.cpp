@@ -0,0 +1,197 @@
+//---------------------------------------------------------------------------
+// C++ Implementation file for the shard link, the connection of a crawler process to its coordinator.
+// The status is read before the pending sites are sent: a shard reporting no
+// unfinished site has already sent every site it found.
+//---------------------------------------------------------------------------
+
+#include "shardLink.h"
+#include "serialize.h"
+#include <cerrno>
+#include <unistd.h>
+#include <poll.h>
+
+using namespace std;
+
+// The link thread wakes up at least this often (ms) to send the pending sites & its status.
+static const int LINK_INTERVAL = 50;
+
+void appendMessage(string &out, uint64_t type, string_view payload) {
+    appendU64(out, payload.size() + sizeof(uint64_t));
+    appendU64(out, type);
+    out.append(payload.data(), payload.size());
+}
+
+//---------------------------------------------------------------------------
+// Take one complete message from the front of in; false if it isn't all there yet.
+//---------------------------------------------------------------------------
+bool readMessage(string_view &in, uint64_t &type, string_view &payload) {
+    string_view rest = in;
+    uint64_t length;
+    if (!readU64(rest, length) || length < sizeof(uint64_t) || rest.size() < length) return false;
+    readU64(rest, type);
+    payload = rest.substr(0, length - sizeof(uint64_t));
+    in = rest.substr(length - sizeof(uint64_t));
+    return true;
+}
+
+void encodeSites(string &out, const vector<SiteTask> &tasks) {
+    appendU64(out, tasks.size());
+    for (auto &task : tasks) {
+        appendString(out, task.hostname);
+        appendU64(out, uint64_t(task.depth));
+    }
+}
+
+bool decodeSites(string_view in, vector<SiteTask> &tasks) {
+    uint64_t count, depth;
+    if (!readU64(in, count) || count > in.size()) return false;
+    tasks.resize(count);
+    for (auto &task : tasks) {
+        if (!readString(in, task.hostname) || !readU64(in, depth)) return false;
+        task.depth = int(depth);
+    }
+    return true;
+}
+
+void encodeTotals(string &out, const CrawlTotals &totals) {
+    appendU64(out, totals.sites);
+    appendU64(out, totals.pages);
+    appendU64(out, totals.pagesFailed);
+    appendU64(out, totals.linkedSites);
+    appendDouble(out, totals.totalResponseTime);
+    appendDouble(out, totals.minResponseTime);
+    appendDouble(out, totals.maxResponseTime);
+}
+
+bool decodeTotals(string_view in, CrawlTotals &totals) {
+    return readU64(in, totals.sites) && readU64(in, totals.pages) && readU64(in, totals.pagesFailed)
+        && readU64(in, totals.linkedSites) && readDouble(in, totals.totalResponseTime)
+        && readDouble(in, totals.minResponseTime) && readDouble(in, totals.maxResponseTime);
+}
+
+//---------------------------------------------------------------------------
+// ShardLink constructor, fd is the connected socket to the coordinator.
+//---------------------------------------------------------------------------
+ShardLink::ShardLink(int fd, int shard, int numShards) : ring(numShards) {
+    this->fd = fd;
+    this->shard = shard;
+    this->outgoing.resize(numShards);
+    this->stopped = false;
+}
+
+ShardLink::~ShardLink() {
+    stopped = true;
+    if (linkThread.joinable()) linkThread.join();
+    if (fd != -1) close(fd);
+}
+
+int ShardLink::getShard() const {
+    return shard;
+}
+
+bool ShardLink::owns(const string &hostname) const {
+    return ring.owner(hostname) == shard;
+}
+
+//---------------------------------------------------------------------------
+// A site of another shard, sent with the next batch.
+//---------------------------------------------------------------------------
+void ShardLink::forward(const SiteTask &task) {
+    lock_guard<mutex> lock(forwardMutex);
+    outgoing[ring.owner(task.hostname)].push_back(task);
+}
+
+void ShardLink::sendOutput(const string &data) {
+    if (!data.empty()) sendMessage(MSG_OUTPUT, data);
+}
+
+bool ShardLink::sendMessage(uint64_t type, string_view payload) {
+    string message;
+    appendMessage(message, type, payload);
+    lock_guard<mutex> lock(sendMutex);
+    size_t done = 0;
+    while (done < message.size()) {
+        ssize_t n = write(fd, message.data() + done, message.size() - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        done += n;
+    }
+    return true;
+}
+
+bool ShardLink::flushForwards() {
+    vector< vector<SiteTask> > batches(outgoing.size());
+    {
+        lock_guard<mutex> lock(forwardMutex);
+        batches.swap(outgoing);
+        outgoing.resize(batches.size());
+    }
+    for (int target = 0; target < int(batches.size()); target++) {
+        if (batches[target].empty()) continue;
+        string payload;
+        appendU64(payload, uint64_t(target));
+        encodeSites(payload, batches[target]);
+        if (!sendMessage(MSG_SITES, payload)) return false;
+    }
+    return true;
+}
+
+void ShardLink::start(function<void(vector<SiteTask>&)> onSites, function<uint64_t()> getUnfinished, function<void()> onStop) {
+    linkThread = thread(&ShardLink::run, this, onSites, getUnfinished, onStop);
+}
+
+//---------------------------------------------------------------------------
+// Link thread: take in the sites of this shard, send the found ones & the status,
+// until the coordinator says stop (or is gone).
+//---------------------------------------------------------------------------
+void ShardLink::run(function<void(vector<SiteTask>&)> onSites, function<uint64_t()> getUnfinished, function<void()> onStop) {
+    string readBuffer;
+    char chunk[65536];
+    uint64_t received = 0, lastUnfinished = UINT64_MAX, lastReceived = UINT64_MAX;
+    bool stopping = false;
+    while (!stopping && !stopped) {
+        struct pollfd entry = {fd, POLLIN, 0};
+        if (poll(&entry, 1, LINK_INTERVAL) > 0) {
+            ssize_t n = read(fd, chunk, sizeof(chunk));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) stopping = true;
+                else readBuffer.append(chunk, n);
+        }
+
+        string_view in(readBuffer), payload;
+        uint64_t type;
+        vector<SiteTask> tasks;
+        while (readMessage(in, type, payload)) {
+            if (type == MSG_STOP) stopping = true;
+            if (type == MSG_SITES && decodeSites(payload, tasks)) onSites(tasks);
+            if (type == MSG_SITES) received++;
+        }
+        readBuffer.erase(0, readBuffer.size() - in.size());
+        if (stopping) break;
+
+        uint64_t unfinished = getUnfinished();
+        if (!flushForwards()) break;
+        if (unfinished != lastUnfinished || received != lastReceived) {
+            string status;
+            appendU64(status, unfinished);
+            appendU64(status, received);
+            if (!sendMessage(MSG_STATUS, status)) break;
+            lastUnfinished = unfinished;
+            lastReceived = received;
+        }
+    }
+    onStop();
+}
+
+//---------------------------------------------------------------------------
+// The crawl is over & the output sent: report the totals & hang up.
+//---------------------------------------------------------------------------
+void ShardLink::finish(const CrawlTotals &totals) {
+    stopped = true;
+    if (linkThread.joinable()) linkThread.join();
+    string payload;
+    encodeTotals(payload, totals);
+    sendMessage(MSG_DONE, payload);
+    close(fd);
+    fd = -1;
+}
@@ -0,0 +1,62 @@
+//---------------------------------------------------------------------------
+// Header File for the shard link, the connection of a crawler process to its coordinator.
+//---------------------------------------------------------------------------
+
+#ifndef SHARDLINK_H
+#define SHARDLINK_H
+
+#include "shardRing.h"
+#include "frontier.h"
+#include "checkpoint.h"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+
+using namespace std;
+
+// Messages are a u64 length, a u64 type & the payload (see serialize.h).
+//   SITES  worker -> coordinator: target shard & sites; coordinator -> worker: sites
+//   OUTPUT worker -> coordinator: formatted site statistics, whole records
+//   STATUS worker -> coordinator: unfinished sites & SITES messages received
+//   DONE   worker -> coordinator: the totals of the shard, last message
+//   STOP   coordinator -> worker: every shard is idle, the crawl is over
+enum ShardMessage { MSG_SITES = 1, MSG_OUTPUT, MSG_STATUS, MSG_DONE, MSG_STOP };
+
+void appendMessage(string &out, uint64_t type, string_view payload);
+bool readMessage(string_view &in, uint64_t &type, string_view &payload);
+void encodeSites(string &out, const vector<SiteTask> &tasks);
+bool decodeSites(string_view in, vector<SiteTask> &tasks);
+void encodeTotals(string &out, const CrawlTotals &totals);
+bool decodeTotals(string_view in, CrawlTotals &totals);
+
+// Worker side. Sites owned by other shards are batched per shard & sent by the
+// link thread, which also receives the sites of this shard & reports its status.
+class ShardLink {
+    public:
+        ShardLink(int fd, int shard, int numShards);
+        ~ShardLink();
+        int getShard() const;
+        bool owns(const string &hostname) const;
+        void forward(const SiteTask &task);
+        void sendOutput(const string &data);
+        void start(function<void(vector<SiteTask>&)> onSites, function<uint64_t()> getUnfinished, function<void()> onStop);
+        void finish(const CrawlTotals &totals);
+    private:
+        int fd, shard;
+        ShardRing ring;
+        mutex sendMutex;                                // one whole message at a time on the socket
+        mutex forwardMutex;
+        vector< vector<SiteTask> > outgoing;            // by owning shard
+        thread linkThread;
+        atomic<bool> stopped;
+        void run(function<void(vector<SiteTask>&)> onSites, function<uint64_t()> getUnfinished, function<void()> onStop);
+        bool sendMessage(uint64_t type, string_view payload);
+        bool flushForwards();
+};
+
+#endif
@@ -0,0 +1,34 @@
+//---------------------------------------------------------------------------
+// C++ Implementation file for the shard ring, consistent hashing of hostnames over crawler processes.
+//---------------------------------------------------------------------------
+
+#include "shardRing.h"
+#include "urlDedup.h"
+#include <algorithm>
+
+using namespace std;
+
+//---------------------------------------------------------------------------
+// ShardRing constructor. The points only depend on the shard numbers, so every
+// process builds the same ring.
+//---------------------------------------------------------------------------
+ShardRing::ShardRing(int numShards, int pointsPerShard) {
+    this->numShards = max(numShards, 1);
+    for (int shard = 0; shard < this->numShards; shard++) {
+        for (int i = 0; i < pointsPerShard; i++) {
+            points.push_back(make_pair(fingerprint("shard-" + to_string(shard) + "-" + to_string(i)), shard));
+        }
+    }
+    sort(points.begin(), points.end());
+}
+
+int ShardRing::owner(const string &hostname) const {
+    if (numShards == 1) return 0;
+    uint64_t key = fingerprint(hostname);
+    auto it = lower_bound(points.begin(), points.end(), make_pair(key, 0));
+    return it == points.end() ? points.front().second : it->second;
+}
+
+int ShardRing::size() const {
+    return numShards;
+}
@@ -0,0 +1,26 @@
+//---------------------------------------------------------------------------
+// Header File for the shard ring, consistent hashing of hostnames over crawler processes.
+//---------------------------------------------------------------------------
+
+#ifndef SHARDRING_H
+#define SHARDRING_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+using namespace std;
+
+// Each shard owns many points of a 64-bit ring; a hostname belongs to the shard
+// of the first point after its fingerprint. Adding a shard moves ~1/N of the hosts.
+class ShardRing {
+    public:
+        ShardRing(int numShards, int pointsPerShard = 64);
+        int owner(const string &hostname) const;
+        int size() const;
+    private:
+        vector< pair<uint64_t, int> > points;           // sorted by position
+        int numShards;
+};
+
+#endif
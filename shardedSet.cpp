@@ -0,0 +1,76 @@
+//---------------------------------------------------------------------------
+// C++ Implementation file for the sharded set, a concurrent set of strings.
+//---------------------------------------------------------------------------
+
+#include "shardedSet.h"
+#include "serialize.h"
+
+using namespace std;
+
+//---------------------------------------------------------------------------
+// ShardedSet constructor, exact fingerprints until configured otherwise.
+//---------------------------------------------------------------------------
+ShardedSet::ShardedSet() {
+    configure(DedupOptions());
+}
+
+//---------------------------------------------------------------------------
+// Set the dedup mode; initialCapacity is for the whole set. Clears the set.
+//---------------------------------------------------------------------------
+void ShardedSet::configure(const DedupOptions &options) {
+    DedupOptions shardOptions = options;
+    shardOptions.initialCapacity = options.initialCapacity / NUM_SHARDS + 1;
+    for (auto &shard : shards) {
+        lock_guard<mutex> lock(shard.m_mutex);
+        shard.keys.reset(new UrlDedup(shardOptions));
+    }
+}
+
+//---------------------------------------------------------------------------
+// Add a key. Return true if it was not in the set yet.
+//---------------------------------------------------------------------------
+bool ShardedSet::insert(const string &key) {
+    uint64_t key64 = fingerprint(key);
+    Shard &shard = shards[(key64 >> 32) % NUM_SHARDS];
+    lock_guard<mutex> lock(shard.m_mutex);
+    return shard.keys->insertFingerprint(key64);
+}
+
+size_t ShardedSet::size() {
+    size_t total = 0;
+    for (auto &shard : shards) {
+        lock_guard<mutex> lock(shard.m_mutex);
+        total += shard.keys->size();
+    }
+    return total;
+}
+
+size_t ShardedSet::memoryBytes() {
+    size_t total = 0;
+    for (auto &shard : shards) {
+        lock_guard<mutex> lock(shard.m_mutex);
+        total += shard.keys->memoryBytes();
+    }
+    return total;
+}
+
+//---------------------------------------------------------------------------
+// Write all shards for a checkpoint, or read them back.
+//---------------------------------------------------------------------------
+void ShardedSet::save(string &out) {
+    appendU64(out, NUM_SHARDS);
+    for (auto &shard : shards) {
+        lock_guard<mutex> lock(shard.m_mutex);
+        shard.keys->save(out);
+    }
+}
+
+bool ShardedSet::load(string_view in) {
+    uint64_t numShards;
+    if (!readU64(in, numShards) || numShards != NUM_SHARDS) return false;
+    for (auto &shard : shards) {
+        lock_guard<mutex> lock(shard.m_mutex);
+        if (!shard.keys->load(in)) return false;
+    }
+    return true;
+}
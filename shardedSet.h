@@ -0,0 +1,36 @@
+//---------------------------------------------------------------------------
+// Header File for the sharded set, a concurrent set of strings.
+//---------------------------------------------------------------------------
+
+#ifndef SHARDEDSET_H
+#define SHARDEDSET_H
+
+#include "urlDedup.h"
+#include <string>
+#include <memory>
+#include <mutex>
+
+using namespace std;
+
+// Each shard has its own lock, so threads only contend on the same shard.
+// Keys are kept as fingerprints (see UrlDedup), not as strings.
+class ShardedSet {
+    public:
+        ShardedSet();
+        void configure(const DedupOptions &options);
+        bool insert(const string &key);
+        size_t size();
+        size_t memoryBytes();
+        void save(string &out);
+        bool load(string_view in);
+    private:
+        static const int NUM_SHARDS = 64;
+        typedef struct {
+            mutex m_mutex;
+            unique_ptr<UrlDedup> keys;
+        } Shard;
+
+        Shard shards[NUM_SHARDS];
+};
+
+#endif
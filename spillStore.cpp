@@ -0,0 +1,199 @@
+//---------------------------------------------------------------------------
+// C++ Implementation file for the spill store, frontier sites kept on disk in append-only segments.
+//---------------------------------------------------------------------------
+
+#include "spillStore.h"
+#include <fstream>
+#include <cstdio>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+// Lines kept before they are written to the segment
+static const size_t WRITE_BUFFER_SIZE = 64 * 1024;
+
+//---------------------------------------------------------------------------
+// SpillStore constructor. Nothing is created on disk until the first site is spilled.
+//---------------------------------------------------------------------------
+SpillStore::SpillStore(const string &directory, size_t segmentTasks) {
+    this->directory = directory.empty() ? "." : directory;
+    this->segmentTasks = max(segmentTasks, size_t(1));
+    this->writerTasks = 0;
+    this->count = 0;
+    this->nextSegmentId = 1;
+    this->writer = -1;
+    this->keepConsumed = false;
+}
+
+SpillStore::~SpillStore() {
+    flushWriter();
+    if (writer != -1) close(writer);
+}
+
+string SpillStore::pathOf(const string &name) const {
+    return directory + "/" + name;
+}
+
+//---------------------------------------------------------------------------
+// Start a new segment, truncating a file left by an older crawl.
+//---------------------------------------------------------------------------
+void SpillStore::openWriter() {
+    char name[32];
+    snprintf(name, sizeof(name), "segment-%06llu.txt", (unsigned long long)nextSegmentId++);
+    closeWriter();
+    mkdir(directory.c_str(), 0755);
+    writer = open(pathOf(name).c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (writer == -1 && error.empty()) error = "Cannot create " + pathOf(name) + "!";
+    segments.push_back(SpillSegment{name, 0, 0, 0});
+    writerTasks = 0;
+}
+
+//---------------------------------------------------------------------------
+// Write the buffered lines to the last segment. Return false if they are lost.
+//---------------------------------------------------------------------------
+bool SpillStore::flushWriter() {
+    size_t written = 0;
+    while (writer != -1 && written < writeBuffer.size()) {
+        ssize_t n = write(writer, writeBuffer.data() + written, writeBuffer.size() - written);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        written += n;
+    }
+    bool ok = written == writeBuffer.size();
+    if (!ok && error.empty()) error = "Cannot write " + pathOf(segments.back().name) + "!";
+    writeBuffer.clear();
+    return ok;
+}
+
+//---------------------------------------------------------------------------
+// Close the last segment once synced; no checkpoint has to sync it again.
+//---------------------------------------------------------------------------
+void SpillStore::closeWriter() {
+    if (writer == -1) return;
+    if (flushWriter() && fsync(writer) != 0 && error.empty()) error = "Cannot sync " + pathOf(segments.back().name) + "!";
+    close(writer);
+    writer = -1;
+}
+
+//---------------------------------------------------------------------------
+// Add a site at the end. A full segment is closed and a new one started.
+// Sites that could not be written are skipped when read back, and the error
+// is returned by getSegments().
+//---------------------------------------------------------------------------
+void SpillStore::append(const SiteTask &task) {
+    if (writer == -1 || writerTasks >= segmentTasks) openWriter();
+    string line = to_string(task.depth) + " " + task.hostname + "\n";
+    writeBuffer += line;
+    segments.back().endOffset += line.size();
+    segments.back().unread++;
+    writerTasks++;
+    count++;
+    if (writeBuffer.size() >= WRITE_BUFFER_SIZE) flushWriter();
+}
+
+//---------------------------------------------------------------------------
+// Read up to maxTasks of the oldest sites. Return the number read.
+//---------------------------------------------------------------------------
+size_t SpillStore::readBatch(size_t maxTasks, vector<SiteTask> &tasks) {
+    size_t numRead = 0;
+    while (numRead < maxTasks && count > 0 && !segments.empty()) {
+        SpillSegment &segment = segments.front();
+        if (segment.unread == 0) {
+            // Fully read: the segment being written is kept, the others retired.
+            if (segments.size() == 1) break;
+            retireFront();
+            continue;
+        }
+        if (segments.size() == 1) flushWriter();
+
+        ifstream reader(pathOf(segment.name));
+        reader.seekg(segment.readOffset);
+        string line;
+        while (numRead < maxTasks && segment.unread > 0 && getline(reader, line)) {
+            segment.readOffset += line.size() + 1;
+            segment.unread--;
+            count--;
+            size_t space = line.find(' ');
+            if (space == string::npos) continue;
+            tasks.push_back(SiteTask{line.substr(space + 1), atoi(line.c_str())});
+            numRead++;
+        }
+        if (segment.unread > 0 && numRead < maxTasks) {
+            // Lost or damaged file, skip what is left of it.
+            count -= segment.unread;
+            segment.unread = 0;
+            segment.readOffset = segment.endOffset;
+        }
+    }
+    return numRead;
+}
+
+//---------------------------------------------------------------------------
+// Drop the oldest segment; delete it now, or after the next checkpoint.
+//---------------------------------------------------------------------------
+void SpillStore::retireFront() {
+    if (keepConsumed) consumed.push_back(segments.front().name);
+        else unlink(pathOf(segments.front().name).c_str());
+    segments.pop_front();
+}
+
+size_t SpillStore::size() const {
+    return count;
+}
+
+//---------------------------------------------------------------------------
+// Read positions for a checkpoint. The last segment and the directory are synced
+// first, so the files on disk hold every site the positions count. Return an
+// error message, empty on success; a checkpoint must not be written after an error.
+//---------------------------------------------------------------------------
+string SpillStore::getSegments(vector<SpillSegment> &saved) {
+    saved.assign(segments.begin(), segments.end());
+    if (writer != -1 && flushWriter() && fsync(writer) != 0 && error.empty()) error = "Cannot sync " + pathOf(segments.back().name) + "!";
+    if (!error.empty()) return error;
+    if (segments.empty()) return "";
+    int fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+    bool synced = fd >= 0 && fsync(fd) == 0;
+    if (fd >= 0) close(fd);
+    return synced ? "" : "Cannot sync " + directory + "!";
+}
+
+//---------------------------------------------------------------------------
+// Continue from checkpointed segments. Lines appended after the checkpoint are
+// cut off, their sites are found again when their parents are re-discovered.
+// A file shorter than its checkpointed end has lost sites: fail.
+//---------------------------------------------------------------------------
+bool SpillStore::restore(const vector<SpillSegment> &saved) {
+    count = 0;
+    for (auto &segment : saved) {
+        struct stat status;
+        string path = pathOf(segment.name);
+        if (stat(path.c_str(), &status) != 0 || uint64_t(status.st_size) < segment.endOffset) return false;
+        if (truncate(path.c_str(), segment.endOffset) != 0) return false;
+        unsigned long long id;
+        if (sscanf(segment.name.c_str(), "segment-%llu", &id) == 1 && id >= nextSegmentId) nextSegmentId = id + 1;
+        count += segment.unread;
+    }
+    closeWriter();
+    segments.assign(saved.begin(), saved.end());
+    return true;
+}
+
+void SpillStore::setKeepConsumed(bool keep) {
+    keepConsumed = keep;
+}
+
+size_t SpillStore::numConsumed() const {
+    return consumed.size();
+}
+
+//---------------------------------------------------------------------------
+// A checkpoint no longer refers to the first numFiles segments read: delete them.
+//---------------------------------------------------------------------------
+void SpillStore::removeConsumed(size_t numFiles) {
+    numFiles = min(numFiles, consumed.size());
+    for (size_t i = 0; i < numFiles; i++) unlink(pathOf(consumed[i]).c_str());
+    consumed.erase(consumed.begin(), consumed.begin() + numFiles);
+}
@@ -0,0 +1,48 @@
+//---------------------------------------------------------------------------
+// Header File for the spill store, frontier sites kept on disk in append-only segments.
+//---------------------------------------------------------------------------
+
+#ifndef SPILLSTORE_H
+#define SPILLSTORE_H
+
+#include "frontier.h"
+#include <string>
+#include <vector>
+#include <deque>
+#include <cstdint>
+
+using namespace std;
+
+// Sites are appended as "depth hostname" lines to the newest segment and read back
+// in order from the oldest one. Not thread safe, the frontier holds a lock around it.
+// A full segment is synced when it is closed, the one being written by getSegments().
+class SpillStore {
+    public:
+        SpillStore(const string &directory, size_t segmentTasks = 65536);
+        ~SpillStore();
+        void append(const SiteTask &task);
+        size_t readBatch(size_t maxTasks, vector<SiteTask> &tasks);
+        size_t size() const;
+        string getSegments(vector<SpillSegment> &saved);
+        bool restore(const vector<SpillSegment> &saved);
+        void setKeepConsumed(bool keep);
+        size_t numConsumed() const;
+        void removeConsumed(size_t numFiles);
+    private:
+        string directory;
+        size_t segmentTasks, writerTasks, count;
+        uint64_t nextSegmentId;
+        deque<SpillSegment> segments;                   // oldest first, the last one is being written
+        int writer;                                     // fd of the last segment, -1 if none
+        string writeBuffer;                             // lines not written to it yet
+        string error;                                   // first write or sync error
+        bool keepConsumed;                              // a checkpoint may still refer to read segments
+        vector<string> consumed;
+        void openWriter();
+        bool flushWriter();
+        void closeWriter();
+        void retireFront();
+        string pathOf(const string &name) const;
+};
+
+#endif
@@ -0,0 +1,128 @@
+//---------------------------------------------------------------------------
+// C++ Implementation file for the string arena & the string table, strings stored once & freed all at once.
+//---------------------------------------------------------------------------
+
+#include "stringArena.h"
+#include "urlDedup.h"
+#include <cstring>
+#include <algorithm>
+
+using namespace std;
+
+// Slots of a new table; it doubles once it is half full.
+static const size_t INITIAL_SLOTS = 256;
+
+//---------------------------------------------------------------------------
+// StringArena constructor. Strings longer than blockSize get a block of their own.
+//---------------------------------------------------------------------------
+StringArena::StringArena(size_t blockSize) {
+    this->blockSize = blockSize;
+    this->current = NULL;
+    this->available = 0;
+    this->allocated = 0;
+    this->firstBlockSize = 0;
+}
+
+//---------------------------------------------------------------------------
+// Copy text into the arena.
+//---------------------------------------------------------------------------
+string_view StringArena::store(string_view text) {
+    if (text.empty()) return string_view();
+    if (text.size() > available) {
+        size_t size = max(blockSize, text.size());
+        blocks.push_back(unique_ptr<char[]>(new char[size]));
+        current = blocks.back().get();
+        if (blocks.size() == 1) firstBlockSize = size;
+        available = size;
+        allocated += size;
+    }
+    char *copy = current;
+    memcpy(copy, text.data(), text.size());
+    current += text.size();
+    available -= text.size();
+    return string_view(copy, text.size());
+}
+
+//---------------------------------------------------------------------------
+// Forget every string; the first block is used again.
+//---------------------------------------------------------------------------
+void StringArena::reset() {
+    if (blocks.empty()) return;
+    // A first block larger than usual held a long string, it is not kept
+    if (firstBlockSize != blockSize) blocks.clear();
+        else blocks.resize(1);
+    allocated = blocks.empty() ? 0 : blockSize;
+    current = blocks.empty() ? NULL : blocks[0].get();
+    available = allocated;
+}
+
+size_t StringArena::memoryBytes() const {
+    return allocated + blocks.capacity() * sizeof(unique_ptr<char[]>);
+}
+
+//---------------------------------------------------------------------------
+// StringTable constructor
+//---------------------------------------------------------------------------
+StringTable::StringTable(size_t blockSize) : arena(blockSize) {
+    this->slots.resize(INITIAL_SLOTS);
+    this->count = 0;
+    this->mask = INITIAL_SLOTS - 1;
+}
+
+//---------------------------------------------------------------------------
+// The stored copy of text; inserted tells if it was seen for the first time.
+//---------------------------------------------------------------------------
+string_view StringTable::intern(string_view text, bool &inserted) {
+    uint64_t hash = fingerprint(text);
+    hash = hash == 0 ? 1 : hash;
+    size_t i = size_t(hash) & mask;
+    while (slots[i].hash != 0) {
+        if (slots[i].hash == hash && slots[i].text == text) {
+            inserted = false;
+            return slots[i].text;
+        }
+        i = (i + 1) & mask;
+    }
+    string_view stored = arena.store(text);
+    slots[i].hash = hash;
+    slots[i].text = stored;
+    inserted = true;
+    if (++count * 2 > slots.size()) grow();
+    return stored;
+}
+
+string_view StringTable::intern(string_view text) {
+    bool inserted;
+    return intern(text, inserted);
+}
+
+size_t StringTable::size() const {
+    return count;
+}
+
+size_t StringTable::memoryBytes() const {
+    return arena.memoryBytes() + slots.capacity() * sizeof(Slot);
+}
+
+//---------------------------------------------------------------------------
+// Forget every string, keeping the memory of the table & the arena's first block.
+//---------------------------------------------------------------------------
+void StringTable::clear() {
+    if (count == 0) return;
+    for (auto &slot : slots) slot.hash = 0;
+    count = 0;
+    arena.reset();
+}
+
+void StringTable::grow() {
+    vector<Slot> old;
+    old.swap(slots);
+    slots.resize(old.size() * 2);
+    mask = slots.size() - 1;
+    for (auto &slot : old) {
+        if (slot.hash == 0) continue;
+        size_t i = size_t(slot.hash) & mask;
+        while (slots[i].hash != 0) i = (i + 1) & mask;
+        slots[i] = slot;
+    }
+}
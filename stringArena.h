@@ -0,0 +1,57 @@
+//---------------------------------------------------------------------------
+// Header File for the string arena & the string table, strings stored once & freed all at once.
+//---------------------------------------------------------------------------
+
+#ifndef STRINGARENA_H
+#define STRINGARENA_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+using namespace std;
+
+// Bump allocator for strings: they are copied into large blocks & the views
+// handed out stay valid until reset(). reset() keeps the first block, so an
+// arena reused for each page stops allocating once it is warm. Not thread safe.
+class StringArena {
+    public:
+        explicit StringArena(size_t blockSize = 16384);
+        string_view store(string_view text);
+        void reset();
+        size_t memoryBytes() const;
+    private:
+        size_t blockSize;
+        vector< unique_ptr<char[]> > blocks;
+        char *current;                                  // free part of the last block
+        size_t available;
+        size_t allocated;                               // bytes of all the blocks
+        size_t firstBlockSize;
+};
+
+// Interned strings: one copy of each distinct string in an arena, found again
+// through an open addressing table of (fingerprint, view). Not thread safe.
+class StringTable {
+    public:
+        explicit StringTable(size_t blockSize = 16384);
+        string_view intern(string_view text, bool &inserted);
+        string_view intern(string_view text);
+        size_t size() const;
+        size_t memoryBytes() const;
+        void clear();
+    private:
+        typedef struct {
+            uint64_t hash;                              // 0 marks an empty slot
+            string_view text;
+        } Slot;
+
+        StringArena arena;
+        vector<Slot> slots;
+        size_t count, mask;
+        void grow();
+};
+
+#endif
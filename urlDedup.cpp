@@ -0,0 +1,372 @@
+//---------------------------------------------------------------------------
+// C++ Implementation file for URL dedup, compact sets of seen URLs and hostnames.
+// URLs are reduced to 64-bit fingerprints: 8 bytes per URL in the exact table (a
+// collision needs ~4 billion URLs to become likely), a few bits in bloom mode.
+//---------------------------------------------------------------------------
+
+#include "urlDedup.h"
+#include "serialize.h"
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+using namespace std;
+using namespace std::chrono;
+
+// One lookup out of LOOKUP_SAMPLE is timed, to estimate the throughput cheaply.
+static const uint64_t LOOKUP_SAMPLE = 64;
+
+static atomic<uint64_t> retiredUrls(0), retiredBytes(0);
+
+// Lookup counters of one thread: only that thread writes them (no contended
+// read-modify-write), getStats() sums them with the ones of the threads gone.
+class ThreadLookups {
+    public:
+        atomic<uint64_t> lookups, sampledLookups, sampledNanos;
+        ThreadLookups();
+        ~ThreadLookups();
+};
+
+static mutex lookupsMutex;
+static set<ThreadLookups *> liveLookups;
+static uint64_t exitedLookups = 0, exitedSampledLookups = 0, exitedSampledNanos = 0;
+static thread_local ThreadLookups threadLookups;
+
+ThreadLookups::ThreadLookups() : lookups(0), sampledLookups(0), sampledNanos(0) {
+    lock_guard<mutex> lock(lookupsMutex);
+    liveLookups.insert(this);
+}
+
+ThreadLookups::~ThreadLookups() {
+    lock_guard<mutex> lock(lookupsMutex);
+    liveLookups.erase(this);
+    exitedLookups += lookups;
+    exitedSampledLookups += sampledLookups;
+    exitedSampledNanos += sampledNanos;
+}
+
+static inline uint64_t bump(atomic<uint64_t> &counter, uint64_t n = 1) {
+    uint64_t value = counter.load(memory_order_relaxed);
+    counter.store(value + n, memory_order_relaxed);
+    return value;
+}
+
+static inline uint64_t rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t finalMix(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+//---------------------------------------------------------------------------
+// 64-bit fingerprint of a URL, 8 bytes at a time. Never 0.
+//---------------------------------------------------------------------------
+uint64_t fingerprint(string_view text) {
+    const uint64_t P1 = 0x9E3779B185EBCA87ULL, P2 = 0xC2B2AE3D27D4EB4FULL;
+    const char *data = text.data();
+    size_t length = text.size(), pos = 0;
+    uint64_t h = P1 ^ (length * P2);
+    for (; pos + 8 <= length; pos += 8) {
+        uint64_t word;
+        memcpy(&word, data + pos, 8);
+        h ^= rotl(word * P2, 31) * P1;
+        h = rotl(h, 27) * P1 + P2;
+    }
+    if (pos < length) {
+        uint64_t tail = 0;
+        memcpy(&tail, data + pos, length - pos);
+        h ^= rotl(tail * P2, 31) * P1;
+    }
+    h = finalMix(h);
+    return h == 0 ? 1 : h;
+}
+
+//---------------------------------------------------------------------------
+// FingerprintSet constructor, the table size is a power of two.
+//---------------------------------------------------------------------------
+FingerprintSet::FingerprintSet(size_t capacity) {
+    size_t size = 16;
+    while (size * 7 < capacity * 10) size *= 2;
+    slots.assign(size, 0);
+    mask = size - 1;
+    count = 0;
+}
+
+bool FingerprintSet::insert(uint64_t key) {
+    if ((count + 1) * 10 > slots.size() * 7) grow();
+    for (size_t i = key & mask; ; i = (i + 1) & mask) {
+        if (slots[i] == key) return false;
+        if (slots[i] == 0) {
+            slots[i] = key;
+            count++;
+            return true;
+        }
+    }
+}
+
+bool FingerprintSet::contains(uint64_t key) const {
+    for (size_t i = key & mask; ; i = (i + 1) & mask) {
+        if (slots[i] == key) return true;
+        if (slots[i] == 0) return false;
+    }
+}
+
+size_t FingerprintSet::size() const { return count; }
+size_t FingerprintSet::memoryBytes() const { return slots.size() * sizeof(uint64_t); }
+
+//---------------------------------------------------------------------------
+// The table is written as is, so loading needs no rehashing.
+//---------------------------------------------------------------------------
+void FingerprintSet::save(string &out) const {
+    appendU64(out, count);
+    appendU64(out, slots.size());
+    out.append((const char *)slots.data(), slots.size() * sizeof(uint64_t));
+}
+
+//---------------------------------------------------------------------------
+// The count must match the used slots & stay under the load factor of insert:
+// probing a full table would never end.
+//---------------------------------------------------------------------------
+bool FingerprintSet::load(string_view &in) {
+    uint64_t newCount, size;
+    if (!readU64(in, newCount) || !readU64(in, size)) return false;
+    if (size < 16 || (size & (size - 1)) != 0 || in.size() / sizeof(uint64_t) < size) return false;
+    vector<uint64_t> newSlots(size);
+    memcpy(newSlots.data(), in.data(), size * sizeof(uint64_t));
+    uint64_t used = 0;
+    for (uint64_t key : newSlots) used += key != 0;
+    if (used != newCount || newCount * 10 > size * 7) return false;
+    in.remove_prefix(size * sizeof(uint64_t));
+    slots.swap(newSlots);
+    count = newCount;
+    mask = size - 1;
+    return true;
+}
+
+void FingerprintSet::grow() {
+    vector<uint64_t> old;
+    old.swap(slots);
+    slots.assign(old.size() * 2, 0);
+    mask = slots.size() - 1;
+    for (uint64_t key : old) {
+        if (key == 0) continue;
+        size_t i = key & mask;
+        while (slots[i] != 0) i = (i + 1) & mask;
+        slots[i] = key;
+    }
+}
+
+//---------------------------------------------------------------------------
+// ScalableBloomFilter constructor. The filters use half, a quarter, ... of the
+// error budget, so their sum stays below falsePositiveRate.
+//---------------------------------------------------------------------------
+ScalableBloomFilter::ScalableBloomFilter(size_t capacity, double falsePositiveRate) {
+    this->count = 0;
+    this->nextRate = falsePositiveRate / 2;
+    addFilter(max(capacity, size_t(64)), nextRate);
+}
+
+void ScalableBloomFilter::addFilter(size_t capacity, double falsePositiveRate) {
+    Filter filter;
+    double ln2 = log(2.0);
+    filter.capacity = capacity;
+    filter.numBits = size_t(ceil(-double(capacity) * log(falsePositiveRate) / (ln2 * ln2)));
+    filter.numBits = max((filter.numBits + 63) / 64 * 64, size_t(64));
+    filter.numHashes = max(size_t(round(double(filter.numBits) / capacity * ln2)), size_t(1));
+    filter.bits.assign(filter.numBits / 64, 0);
+    filter.count = 0;
+    filters.push_back(filter);
+    nextRate = falsePositiveRate / 2;
+}
+
+//---------------------------------------------------------------------------
+// Bit positions come from double hashing of the fingerprint.
+//---------------------------------------------------------------------------
+bool ScalableBloomFilter::filterContains(const Filter &filter, uint64_t key) {
+    uint64_t h1 = key, h2 = rotl(key, 32) | 1;
+    for (size_t i = 0; i < filter.numHashes; i++) {
+        uint64_t bit = (h1 + i * h2) % filter.numBits;
+        if ((filter.bits[bit / 64] & (1ULL << (bit % 64))) == 0) return false;
+    }
+    return true;
+}
+
+bool ScalableBloomFilter::contains(uint64_t key) const {
+    for (auto &filter : filters) {
+        if (filterContains(filter, key)) return true;
+    }
+    return false;
+}
+
+bool ScalableBloomFilter::insert(uint64_t key) {
+    if (contains(key)) return false;
+    if (filters.back().count >= filters.back().capacity) addFilter(filters.back().capacity * 2, nextRate);
+
+    Filter &filter = filters.back();
+    uint64_t h1 = key, h2 = rotl(key, 32) | 1;
+    for (size_t i = 0; i < filter.numHashes; i++) {
+        uint64_t bit = (h1 + i * h2) % filter.numBits;
+        filter.bits[bit / 64] |= 1ULL << (bit % 64);
+    }
+    filter.count++;
+    count++;
+    return true;
+}
+
+size_t ScalableBloomFilter::size() const { return count; }
+
+size_t ScalableBloomFilter::memoryBytes() const {
+    size_t total = 0;
+    for (auto &filter : filters) total += filter.bits.size() * sizeof(uint64_t);
+    return total;
+}
+
+void ScalableBloomFilter::save(string &out) const {
+    appendU64(out, count);
+    appendDouble(out, nextRate);
+    appendU64(out, filters.size());
+    for (auto &filter : filters) {
+        appendU64(out, filter.numBits);
+        appendU64(out, filter.numHashes);
+        appendU64(out, filter.capacity);
+        appendU64(out, filter.count);
+        out.append((const char *)filter.bits.data(), filter.bits.size() * sizeof(uint64_t));
+    }
+}
+
+bool ScalableBloomFilter::load(string_view &in) {
+    uint64_t newCount, numFilters;
+    double rate;
+    if (!readU64(in, newCount) || !readDouble(in, rate) || !readU64(in, numFilters) || numFilters == 0) return false;
+    vector<Filter> newFilters(numFilters);
+    for (auto &filter : newFilters) {
+        uint64_t numBits, numHashes, capacity, filterCount;
+        if (!readU64(in, numBits) || !readU64(in, numHashes) || !readU64(in, capacity) || !readU64(in, filterCount)) return false;
+        if (numBits == 0 || numBits % 64 != 0 || in.size() < numBits / 8) return false;
+        filter.numBits = numBits;
+        filter.numHashes = numHashes;
+        filter.capacity = capacity;
+        filter.count = filterCount;
+        filter.bits.resize(numBits / 64);
+        memcpy(filter.bits.data(), in.data(), numBits / 8);
+        in.remove_prefix(numBits / 8);
+    }
+    filters.swap(newFilters);
+    nextRate = rate;
+    count = newCount;
+    return true;
+}
+
+//---------------------------------------------------------------------------
+// UrlDedup constructor
+//---------------------------------------------------------------------------
+UrlDedup::UrlDedup(const DedupOptions &options) {
+    if (options.bloom) bloom.reset(new ScalableBloomFilter(options.initialCapacity, options.falsePositiveRate));
+        else exact.reset(new FingerprintSet(options.initialCapacity));
+}
+
+//---------------------------------------------------------------------------
+// The set is gone, keep its size for the final report.
+//---------------------------------------------------------------------------
+UrlDedup::~UrlDedup() {
+    retiredUrls += size();
+    retiredBytes += memoryBytes();
+}
+
+//---------------------------------------------------------------------------
+// Add a URL. Return true if it was not seen before.
+//---------------------------------------------------------------------------
+bool UrlDedup::insert(string_view url) {
+    ThreadLookups &counters = threadLookups;
+    if (bump(counters.lookups) % LOOKUP_SAMPLE != 0) {
+        uint64_t key = fingerprint(url);
+        return exact ? exact->insert(key) : bloom->insert(key);
+    }
+    steady_clock::time_point start = steady_clock::now();
+    uint64_t key = fingerprint(url);
+    bool inserted = exact ? exact->insert(key) : bloom->insert(key);
+    bump(counters.sampledNanos, duration_cast<nanoseconds>(steady_clock::now() - start).count());
+    bump(counters.sampledLookups);
+    return inserted;
+}
+
+bool UrlDedup::insertFingerprint(uint64_t key) {
+    bump(threadLookups.lookups);
+    return exact ? exact->insert(key) : bloom->insert(key);
+}
+
+bool UrlDedup::contains(string_view url) const {
+    return containsFingerprint(fingerprint(url));
+}
+
+bool UrlDedup::containsFingerprint(uint64_t key) const {
+    bump(threadLookups.lookups);
+    return exact ? exact->contains(key) : bloom->contains(key);
+}
+
+size_t UrlDedup::size() const {
+    return exact ? exact->size() : bloom->size();
+}
+
+size_t UrlDedup::memoryBytes() const {
+    return exact ? exact->memoryBytes() : bloom->memoryBytes();
+}
+
+//---------------------------------------------------------------------------
+// Write the set for a checkpoint. load() takes the mode stored in the data,
+// and leaves the set as it was if the data is damaged.
+//---------------------------------------------------------------------------
+void UrlDedup::save(string &out) const {
+    appendU64(out, exact ? 0 : 1);
+    if (exact) exact->save(out);
+        else bloom->save(out);
+}
+
+bool UrlDedup::load(string_view &in) {
+    uint64_t mode;
+    if (!readU64(in, mode)) return false;
+    if (mode == 0) {
+        unique_ptr<FingerprintSet> loaded(new FingerprintSet());
+        if (!loaded->load(in)) return false;
+        exact.swap(loaded);
+        bloom.reset();
+        return true;
+    }
+    unique_ptr<ScalableBloomFilter> loaded(new ScalableBloomFilter(64, 0.5));
+    if (!loaded->load(in)) return false;
+    bloom.swap(loaded);
+    exact.reset();
+    return true;
+}
+
+//---------------------------------------------------------------------------
+// Process-wide lookup counters (summed over the threads) & the sizes of the sets already freed.
+//---------------------------------------------------------------------------
+DedupStats UrlDedup::getStats() {
+    DedupStats stats;
+    uint64_t sampledLookups, sampledNanos;
+    {
+        lock_guard<mutex> lock(lookupsMutex);
+        stats.lookups = exitedLookups;
+        sampledLookups = exitedSampledLookups;
+        sampledNanos = exitedSampledNanos;
+        for (auto counters : liveLookups) {
+            stats.lookups += counters->lookups.load(memory_order_relaxed);
+            sampledLookups += counters->sampledLookups.load(memory_order_relaxed);
+            sampledNanos += counters->sampledNanos.load(memory_order_relaxed);
+        }
+    }
+    stats.nanosPerLookup = sampledLookups > 0 ? double(sampledNanos) / sampledLookups : 0;
+    stats.retiredUrls = retiredUrls;
+    stats.retiredBytes = retiredBytes;
+    return stats;
+}
@@ -0,0 +1,90 @@
+//---------------------------------------------------------------------------
+// Header File for URL dedup, compact sets of seen URLs and hostnames.
+//---------------------------------------------------------------------------
+
+#ifndef URLDEDUP_H
+#define URLDEDUP_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+using namespace std;
+
+uint64_t fingerprint(string_view text);
+
+typedef struct {
+    bool bloom = false;                                 // scalable Bloom filter instead of exact fingerprints
+    double falsePositiveRate = 0.001;                   // bloom mode: overall rate of "seen" for a new URL
+    size_t initialCapacity = 16;                        // URLs before the first growth
+} DedupOptions;
+
+typedef struct {
+    uint64_t lookups = 0;                               // insert & contains calls
+    double nanosPerLookup = 0;                          // sampled average
+    uint64_t retiredUrls = 0;                           // URLs of the sets already freed
+    uint64_t retiredBytes = 0;                          // memory of the sets already freed
+} DedupStats;
+
+// Open addressing table of 64-bit fingerprints, linear probing, 0 marks an empty slot.
+class FingerprintSet {
+    public:
+        explicit FingerprintSet(size_t capacity = 64);
+        bool insert(uint64_t key);
+        bool contains(uint64_t key) const;
+        size_t size() const;
+        size_t memoryBytes() const;
+        void save(string &out) const;
+        bool load(string_view &in);
+    private:
+        vector<uint64_t> slots;
+        size_t count, mask;
+        void grow();
+};
+
+// Bloom filters added with doubling capacity & tightening error rate, so the
+// overall false positive rate stays below the configured one however many URLs arrive.
+class ScalableBloomFilter {
+    public:
+        ScalableBloomFilter(size_t capacity, double falsePositiveRate);
+        bool insert(uint64_t key);
+        bool contains(uint64_t key) const;
+        size_t size() const;
+        size_t memoryBytes() const;
+        void save(string &out) const;
+        bool load(string_view &in);
+    private:
+        typedef struct {
+            vector<uint64_t> bits;
+            size_t numBits, numHashes, capacity, count;
+        } Filter;
+
+        vector<Filter> filters;
+        double nextRate;
+        size_t count;
+        void addFilter(size_t capacity, double falsePositiveRate);
+        static bool filterContains(const Filter &filter, uint64_t key);
+};
+
+class UrlDedup {
+    public:
+        explicit UrlDedup(const DedupOptions &options = DedupOptions());
+        ~UrlDedup();
+        bool insert(string_view url);
+        bool contains(string_view url) const;
+        bool insertFingerprint(uint64_t key);
+        bool containsFingerprint(uint64_t key) const;
+        size_t size() const;
+        size_t memoryBytes() const;
+        void save(string &out) const;
+        bool load(string_view &in);
+        static DedupStats getStats();
+    private:
+        unique_ptr<FingerprintSet> exact;
+        unique_ptr<ScalableBloomFilter> bloom;
+};
+
+#endif
@@ -0,0 +1,180 @@
+//---------------------------------------------------------------------------
+// C++ Implementation file for the URL filter, allow/deny rules compiled once & checked on every link.
+//---------------------------------------------------------------------------
+
+#include "urlFilter.h"
+#include <algorithm>
+#include <fnmatch.h>
+
+using namespace std;
+
+static const char *TYPE_NAMES[NUM_RULE_TYPES] = {"tld", "ext", "host", "path"};
+
+// Rules used for a type that config.txt has no rule for.
+static const char *DEFAULT_TLDS[] = {".com", ".sg", ".net", ".co", ".org", ".me"};
+static const char *DEFAULT_EXTENSIONS[] = {".css", ".js", ".pdf", ".png", ".jpeg", ".jpg", ".ico"};
+
+UrlFilter::RuleTrie::RuleTrie() {
+    nodes.resize(1);
+}
+
+//---------------------------------------------------------------------------
+// Add a key, read backwards for a suffix rule. An exact rule only matches the whole text.
+//---------------------------------------------------------------------------
+void UrlFilter::RuleTrie::add(string_view key, int rule, bool reversed, bool exact) {
+    int node = 0;
+    for (size_t i = 0; i < key.size(); i++) {
+        char ch = reversed ? key[key.size() - 1 - i] : key[i];
+        int next = -1;
+        for (auto &child : nodes[node].children) {
+            if (child.first == ch) next = child.second;
+        }
+        if (next == -1) {
+            next = int(nodes.size());
+            nodes[node].children.push_back(make_pair(ch, next));
+            nodes.emplace_back();
+        }
+        node = next;
+    }
+    if (exact) nodes[node].exactRules.push_back(rule);
+        else nodes[node].rules.push_back(rule);
+}
+
+//---------------------------------------------------------------------------
+// Walk the text (from its end if reversed) until the trie has no way on or
+// the stop character; collect the rules of the nodes passed.
+//---------------------------------------------------------------------------
+void UrlFilter::RuleTrie::match(string_view text, bool reversed, char stop, vector<int> &matched) const {
+    int node = 0;
+    for (size_t i = 0; i < text.size(); i++) {
+        char ch = reversed ? text[text.size() - 1 - i] : text[i];
+        if (stop && ch == stop) return;
+        int next = -1;
+        for (auto &child : nodes[node].children) {
+            if (child.first == ch) next = child.second;
+        }
+        if (next == -1) return;
+        node = next;
+        matched.insert(matched.end(), nodes[node].rules.begin(), nodes[node].rules.end());
+    }
+    matched.insert(matched.end(), nodes[node].exactRules.begin(), nodes[node].exactRules.end());
+}
+
+UrlFilter &UrlFilter::instance() {
+    static UrlFilter filter;
+    return filter;
+}
+
+UrlFilter::UrlFilter() {
+    checked = rejected = 0;
+    compiled = false;
+    for (int type = 0; type < NUM_RULE_TYPES; type++) hasAllow[type] = false;
+}
+
+//---------------------------------------------------------------------------
+// A rule from config.txt: "allow|deny tld|ext|host|path pattern".
+// Return Error Description or "".
+//---------------------------------------------------------------------------
+string UrlFilter::addRule(const string &action, const string &type, const string &pattern) {
+    if (compiled) return "URL filter rules must be added before the crawl starts!";
+    if (action != "allow" && action != "deny") return "Unknown URL filter action " + action + "!";
+    int ruleType = int(find(TYPE_NAMES, TYPE_NAMES + NUM_RULE_TYPES, type) - TYPE_NAMES);
+    if (ruleType == NUM_RULE_TYPES) return "Unknown URL filter rule type " + type + "!";
+    if (pattern.empty()) return "Empty URL filter pattern!";
+
+    // URLs are compared in lowercase, as the extractor gives them
+    Rule rule;
+    rule.type = FilterRuleType(ruleType);
+    rule.allow = action == "allow";
+    rule.pattern = pattern;
+    transform(rule.pattern.begin(), rule.pattern.end(), rule.pattern.begin(), ::tolower);
+    if ((rule.type == RULE_TLD || rule.type == RULE_EXTENSION) && rule.pattern[0] != '.') rule.pattern = "." + rule.pattern;
+    if (rule.type == RULE_PATH && rule.pattern[0] != '/') rule.pattern = "/" + rule.pattern;
+    rules.push_back(rule);
+    return "";
+}
+
+void UrlFilter::addDefaults() {
+    bool configured[NUM_RULE_TYPES] = {false, false, false, false};
+    for (auto &rule : rules) configured[rule.type] = true;
+    if (!configured[RULE_TLD]) {
+        for (auto tld : DEFAULT_TLDS) addRule("allow", "tld", tld);
+    }
+    if (!configured[RULE_EXTENSION]) {
+        for (auto extension : DEFAULT_EXTENSIONS) addRule("deny", "ext", extension);
+    }
+}
+
+//---------------------------------------------------------------------------
+// Build the tries. Called once, before the first accept().
+//---------------------------------------------------------------------------
+void UrlFilter::compile() {
+    if (compiled) return;
+    addDefaults();
+    for (int id = 0; id < int(rules.size()); id++) {
+        Rule &rule = rules[id];
+        if (rule.allow) hasAllow[rule.type] = true;
+        if (rule.type == RULE_TLD) hostSuffixes.add(rule.pattern, id, true, false);
+        else if (rule.type == RULE_EXTENSION) extensions.add(rule.pattern, id, true, false);
+        else if (rule.type == RULE_PATH) pathPrefixes.add(rule.pattern, id, false, false);
+        else if (rule.pattern.find('*') == string::npos) hostSuffixes.add(rule.pattern, id, true, true);
+        else if (rule.pattern.compare(0, 2, "*.") == 0 && rule.pattern.find('*', 1) == string::npos) hostSuffixes.add(rule.pattern.substr(1), id, true, false);
+        else hostGlobs.push_back(id);
+    }
+    hits.reset(new atomic<uint64_t>[rules.size()]);
+    for (size_t id = 0; id < rules.size(); id++) hits[id] = 0;
+    compiled = true;
+}
+
+//---------------------------------------------------------------------------
+// Should the URL be crawled? host is empty for a link inside the same host.
+//---------------------------------------------------------------------------
+bool UrlFilter::accept(string_view host, string_view path) {
+    static thread_local vector<int> matched;
+    checked.fetch_add(1, memory_order_relaxed);
+    if (host.find("mailto:") != string_view::npos || path.find("mailto:") != string_view::npos) {
+        rejected.fetch_add(1, memory_order_relaxed);
+        return false;
+    }
+
+    matched.clear();
+    if (!host.empty()) {
+        hostSuffixes.match(host, true, 0, matched);
+        if (!hostGlobs.empty()) {
+            string hostname(host);
+            for (int id : hostGlobs) {
+                if (fnmatch(rules[id].pattern.c_str(), hostname.c_str(), 0) == 0) matched.push_back(id);
+            }
+        }
+    }
+    extensions.match(path, true, '/', matched);
+    pathPrefixes.match(path, false, 0, matched);
+
+    bool allowed[NUM_RULE_TYPES] = {false, false, false, false}, denied = false;
+    for (int id : matched) {
+        hits[id].fetch_add(1, memory_order_relaxed);
+        if (rules[id].allow) allowed[rules[id].type] = true;
+            else denied = true;
+    }
+    if (!host.empty() && hasAllow[RULE_TLD] && !allowed[RULE_TLD]) denied = true;
+    if (!host.empty() && hasAllow[RULE_HOST] && !allowed[RULE_HOST]) denied = true;
+    if (hasAllow[RULE_PATH] && !allowed[RULE_PATH]) denied = true;
+    if (hasAllow[RULE_EXTENSION] && !allowed[RULE_EXTENSION]) {
+        size_t slash = path.rfind('/');
+        if (path.find('.', slash == string_view::npos ? 0 : slash) != string_view::npos) denied = true;
+    }
+    if (denied) rejected.fetch_add(1, memory_order_relaxed);
+    return !denied;
+}
+
+FilterStats UrlFilter::getStats() const {
+    FilterStats stats;
+    stats.checked = checked;
+    stats.rejected = rejected;
+    for (size_t id = 0; id < rules.size(); id++) {
+        const Rule &rule = rules[id];
+        string description = string(rule.allow ? "allow " : "deny ") + TYPE_NAMES[rule.type] + " " + rule.pattern;
+        stats.rules.push_back(FilterRuleStats{description, compiled ? uint64_t(hits[id]) : 0});
+    }
+    return stats;
+}
@@ -0,0 +1,80 @@
+//---------------------------------------------------------------------------
+// Header File for the URL filter, allow/deny rules compiled once & checked on every link.
+//---------------------------------------------------------------------------
+
+#ifndef URLFILTER_H
+#define URLFILTER_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+
+using namespace std;
+
+enum FilterRuleType { RULE_TLD, RULE_EXTENSION, RULE_HOST, RULE_PATH, NUM_RULE_TYPES };
+
+typedef struct {
+    string rule;                                        // as in config.txt, e.g. "deny ext .css"
+    uint64_t hits;                                      // URLs it matched
+} FilterRuleStats;
+
+typedef struct {
+    uint64_t checked = 0;                               // URLs classified
+    uint64_t rejected = 0;                              // of them, not crawled
+    vector<FilterRuleStats> rules;
+} FilterStats;
+
+// Rules of a type:
+//   tld  - hostname suffix, ".com"
+//   ext  - extension of the last path segment, ".css"
+//   host - hostname glob, "www.example.com", "*.example.com", "ads.*"
+//   path - path prefix, "/private/"
+// A URL matching a deny rule is rejected. If a type has allow rules, a URL must
+// match one of them (ext: if its path has an extension). Host & tld rules don't
+// apply to links inside the same host. Suffix rules are kept in tries walked from
+// the end of the hostname / path, prefix rules in a trie walked from its start:
+// one pass over each part of the URL whatever the number of rules.
+class UrlFilter {
+    public:
+        static UrlFilter &instance();
+        string addRule(const string &action, const string &type, const string &pattern);
+        void compile();
+        bool accept(string_view host, string_view path);
+        FilterStats getStats() const;
+    private:
+        typedef struct {
+            FilterRuleType type;
+            bool allow;
+            string pattern;
+        } Rule;
+
+        typedef struct {
+            vector< pair<char, int> > children;
+            vector<int> rules;                          // match when the node is reached
+            vector<int> exactRules;                     // match when the node is reached at the end
+        } TrieNode;
+
+        class RuleTrie {
+            public:
+                RuleTrie();
+                void add(string_view key, int rule, bool reversed, bool exact);
+                void match(string_view text, bool reversed, char stop, vector<int> &matched) const;
+            private:
+                vector<TrieNode> nodes;
+        };
+
+        UrlFilter();
+        vector<Rule> rules;
+        RuleTrie hostSuffixes, extensions, pathPrefixes;
+        vector<int> hostGlobs;                          // globs that are not a plain suffix
+        bool hasAllow[NUM_RULE_TYPES];
+        unique_ptr< atomic<uint64_t>[] > hits;
+        atomic<uint64_t> checked, rejected;
+        bool compiled;
+        void addDefaults();
+};
+
+#endif